@@ -5,6 +5,7 @@
 #include <vector>
 #include <unordered_map>
 #include <chrono>
+#include "metrics.h"
 #include <omp.h>
 
 // Structure to hold column data for 'part'
@@ -40,8 +41,58 @@ std::vector<std::string> splitLine(const std::string &line, char delimiter) {
     return fields;
 }
 
-// Load 'part' table data into a map
+// Block of input lines flowing through the task graph, with what its parse or probe task produced
+struct JoinBlock {
+    std::vector<std::string> lines;
+    std::vector<Part> parts;
+    std::string output;
+    long long rowsWritten = 0;
+};
+
+// Lines per block
+const size_t JOIN_BLOCK_ROWS = 4096;
+
+// Blocks in flight: enough for every thread to work on one while the reading thread fills the next
+int joinBlockSlots() {
+    return 2 * omp_get_max_threads() + 2;
+}
+
+// Read the next block of lines; false at the end of the file
+bool readJoinBlock(std::ifstream &file, JoinBlock &block, long long &rowsRead, long long &bytesRead) {
+    block.lines.clear();
+    std::string line;
+    while (block.lines.size() < JOIN_BLOCK_ROWS && std::getline(file, line)) {
+        rowsRead++;
+        bytesRead += line.size() + 1;
+        block.lines.push_back(line);
+    }
+    return !block.lines.empty();
+}
+
+// Parse one 'part' line; false if malformed
+bool parsePart(const std::string &line, Part &part) {
+    auto fields = splitLine(line, '|');
+    if (fields.size() != 9) {
+        return false;
+    }
+    part = {
+        std::stoi(fields[0]),
+        fields[1],
+        fields[2],
+        fields[3],
+        fields[4],
+        std::stoi(fields[5]),
+        fields[6],
+        std::stod(fields[7]),
+        fields[8]
+    };
+    return true;
+}
+
+// Load 'part' table data into a map.
+// Task graph per block: parse (in parallel across blocks) -> insert into the map (one block at a time, in file order).
 std::unordered_map<int, Part> loadPartTable(const std::string &filePath) {
+    MetricsPhase phase("hash build");
     std::ifstream file(filePath);
     if (!file.is_open()) {
         std::cerr << "Error opening PART file." << std::endl;
@@ -49,96 +100,139 @@ std::unordered_map<int, Part> loadPartTable(const std::string &filePath) {
     }
 
     std::unordered_map<int, Part> partMap;
-    std::string line;
-    while (std::getline(file, line)) {
-        auto fields = splitLine(line, '|');
-        if (fields.size() != 9) {
-            std::cerr << "Malformed PART row: " << line << std::endl;
-            continue;
-        }
+    std::vector<JoinBlock> blocks(joinBlockSlots());
+    long long rowsRead = 0, bytesRead = 0;
 
-        Part part = {
-            std::stoi(fields[0]),
-            fields[1],
-            fields[2],
-            fields[3],
-            fields[4],
-            std::stoi(fields[5]),
-            fields[6],
-            std::stod(fields[7]),
-            fields[8]
-        };
-
-        partMap[part.p_partkey] = part;
+    phase.beginParallel(omp_get_max_threads());
+    #pragma omp parallel proc_bind(close)
+    #pragma omp single
+    {
+        for (size_t blockIndex = 0;; ++blockIndex) {
+            JoinBlock *block = &blocks[blockIndex % blocks.size()];
+
+            // Wait until the tasks of the block that used this slot before are done
+            #pragma omp taskwait depend(inout: block[0])
+            if (!readJoinBlock(file, *block, rowsRead, bytesRead)) break;
+
+            #pragma omp task depend(inout: block[0]) firstprivate(block)
+            {
+                double busyStart = phase.now();
+                block->parts.clear();
+                for (const auto &line : block->lines) {
+                    Part part;
+                    if (!parsePart(line, part)) {
+                        #pragma omp critical
+                        std::cerr << "Malformed PART row: " << line << std::endl;
+                        continue;
+                    }
+                    block->parts.push_back(std::move(part));
+                }
+                phase.threadDone(omp_get_thread_num(), busyStart);
+            }
+
+            #pragma omp task depend(in: block[0]) depend(inout: partMap) firstprivate(block)
+            {
+                double busyStart = phase.now();
+                for (auto &part : block->parts) {
+                    partMap[part.p_partkey] = std::move(part);
+                }
+                phase.threadDone(omp_get_thread_num(), busyStart);
+            }
+        }
+        #pragma omp taskwait
     }
+    phase.endParallel();
+
     file.close();
+    phase.read(rowsRead, bytesRead);
     return partMap;
 }
 
-// Process 'partsupp' table and perform join with OpenMP parallelization
+// Process 'partsupp' table and perform join with OpenMP tasks.
+// Task graph per block: probe (in parallel across blocks) -> write (one block at a time, in file order),
+// so reading, probing and writing overlap and the output keeps the order of 'partsupp'.
 void processPartSupp(const std::string &partSuppFile, const std::unordered_map<int, Part> &partMap, const std::string &outputFile) {
+    MetricsPhase phase("probe + output");
     std::ifstream file(partSuppFile);
     if (!file.is_open()) {
         std::cerr << "Error opening PARTSUPP file." << std::endl;
         exit(1);
     }
 
-    // Vector to hold lines for processing
-    std::vector<std::string> lines;
-    std::string line;
-    while (std::getline(file, line)) {
-        lines.push_back(line);
-    }
-    file.close();
-
-    // Use OpenMP to parallelize processing
     std::ofstream outFile(outputFile);
     if (!outFile.is_open()) {
         std::cerr << "Error opening output file." << std::endl;
         exit(1);
     }
 
-    // Protect output file writing
-    #pragma omp parallel
+    std::vector<JoinBlock> blocks(joinBlockSlots());
+    long long rowsRead = 0, bytesRead = 0, rowsWritten = 0;
+
+    phase.beginParallel(omp_get_max_threads());
+    #pragma omp parallel proc_bind(close)
+    #pragma omp single
     {
-        std::ostringstream localBuffer;
-
-        #pragma omp for
-        for (size_t i = 0; i < lines.size(); ++i) {
-            auto fields = splitLine(lines[i], '|');
-            if (fields.size() != 5) {
-                std::cerr << "Malformed PARTSUPP row: " << lines[i] << std::endl;
-                continue;
-            }
+        for (size_t blockIndex = 0;; ++blockIndex) {
+            JoinBlock *block = &blocks[blockIndex % blocks.size()];
+
+            // Wait until the tasks of the block that used this slot before are done
+            #pragma omp taskwait depend(inout: block[0])
+            if (!readJoinBlock(file, *block, rowsRead, bytesRead)) break;
+
+            #pragma omp task depend(inout: block[0]) firstprivate(block)
+            {
+                double busyStart = phase.now();
+                std::ostringstream localBuffer;
+                block->rowsWritten = 0;
+                for (const auto &line : block->lines) {
+                    auto fields = splitLine(line, '|');
+                    if (fields.size() != 5) {
+                        #pragma omp critical
+                        std::cerr << "Malformed PARTSUPP row: " << line << std::endl;
+                        continue;
+                    }
+
+                    PartSupp partsupp = {
+                        std::stoi(fields[0]),
+                        std::stoi(fields[1]),
+                        std::stoi(fields[2]),
+                        std::stod(fields[3]),
+                        fields[4]
+                    };
 
-            PartSupp partsupp = {
-                std::stoi(fields[0]),
-                std::stoi(fields[1]),
-                std::stoi(fields[2]),
-                std::stod(fields[3]),
-                fields[4]
-            };
-
-            // Check if part exists in the map
-            if (partMap.find(partsupp.ps_partkey) != partMap.end()) {
-                const Part &part = partMap.at(partsupp.ps_partkey);
-
-                // Append to local buffer
-                localBuffer << part.p_partkey << "|" << part.p_name << "|" << part.p_mfgr << "|"
-                            << part.p_brand << "|" << part.p_type << "|" << part.p_size << "|"
-                            << part.p_container << "|" << part.p_retailprice << "|" << part.p_comment << "|"
-                            << partsupp.ps_suppkey << "|" << partsupp.ps_availqty << "|"
-                            << partsupp.ps_supplycost << "|" << partsupp.ps_comment << "\n";
+                    // Check if part exists in the map
+                    auto it = partMap.find(partsupp.ps_partkey);
+                    if (it != partMap.end()) {
+                        const Part &part = it->second;
+
+                        // Append to the output of the block
+                        localBuffer << part.p_partkey << "|" << part.p_name << "|" << part.p_mfgr << "|"
+                                    << part.p_brand << "|" << part.p_type << "|" << part.p_size << "|"
+                                    << part.p_container << "|" << part.p_retailprice << "|" << part.p_comment << "|"
+                                    << partsupp.ps_suppkey << "|" << partsupp.ps_availqty << "|"
+                                    << partsupp.ps_supplycost << "|" << partsupp.ps_comment << "\n";
+                        block->rowsWritten++;
+                    }
+                }
+                block->output = localBuffer.str();
+                phase.threadDone(omp_get_thread_num(), busyStart);
             }
-        }
 
-        // Write from local buffer to the output file
-        #pragma omp critical
-        {
-            outFile << localBuffer.str();
+            #pragma omp task depend(in: block[0]) depend(inout: outFile) firstprivate(block)
+            {
+                double busyStart = phase.now();
+                outFile << block->output;
+                rowsWritten += block->rowsWritten;
+                phase.threadDone(omp_get_thread_num(), busyStart);
+            }
         }
+        #pragma omp taskwait
     }
+    phase.endParallel();
 
+    file.close();
+    phase.read(rowsRead, bytesRead);
+    phase.write(rowsWritten, outFile.tellp());
     outFile.close();
 }
 
@@ -147,6 +241,7 @@ int main() {
     std::string partSuppFilePath = "TPC-H/dbgen/partsupp.tbl";
     std::string outputFilePath = "join_results_parallel.tbl";
 
+    metricsInit();
     auto start_time = std::chrono::high_resolution_clock::now();
 
     // Load part table into a hash map
@@ -158,6 +253,7 @@ int main() {
     auto end_time = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> elapsed_time = end_time - start_time;
     std::cout << "Elapsed time: " << elapsed_time.count() << " seconds." << std::endl;
+    metricsReport();
 
     return 0;
 }
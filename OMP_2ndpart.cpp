@@ -5,6 +5,15 @@
 #include <algorithm>
 #include <omp.h>
 #include <chrono>
+#include <queue>
+#include <limits>
+#include <unistd.h>
+#include <cstdio>
+#include <iomanip>
+#include "metrics.h"
+#include "sort_options.h"
+#include "checkpoint.h"
+#include "zone_map.h"
 
 struct LineItem {
     int l_orderkey;
@@ -60,233 +69,491 @@ LineItem parseLineItem(const std::string &line) {
     return item;
 }
 
-// Separate columns into chunks with OpenMP parallelization
-void separateColumnsToChunksWithBuffer(const std::string &inputFile, int bufferSize) {
-    std::ifstream inFile(inputFile);
-    std::vector<std::ofstream> columnFiles(16);
-
-    // Open files sequentially
-    for (int i = 0; i < 16; ++i) {
-        columnFiles[i].open("chunk_col" + std::to_string(i + 1) + ".tbl");
-        if (!columnFiles[i].is_open()) {
-            std::cerr << "Error opening file for column " << i + 1 << std::endl;
-            return;
+// Write one column of a parsed block to its chunk file
+void writeColumnChunk(std::ofstream &file, int column, const std::vector<LineItem> &items) {
+    for (const auto &item : items) {
+        switch (column) {
+            case 0: file << item.l_orderkey << "\n"; break;
+            case 1: file << item.l_partkey << "\n"; break;
+            case 2: file << item.l_suppkey << "\n"; break;
+            case 3: file << item.l_linenumber << "\n"; break;
+            case 4: file << item.l_quantity << "\n"; break;
+            case 5: file << item.l_extendedprice << "\n"; break;
+            case 6: file << item.l_discount << "\n"; break;
+            case 7: file << item.l_tax << "\n"; break;
+            case 8: file << item.l_returnflag << "\n"; break;
+            case 9: file << item.l_linestatus << "\n"; break;
+            case 10: file << item.l_shipDATE << "\n"; break;
+            case 11: file << item.l_commitDATE << "\n"; break;
+            case 12: file << item.l_receiptDATE << "\n"; break;
+            case 13: file << item.l_shipinstruct << "\n"; break;
+            case 14: file << item.l_shipmode << "\n"; break;
+            case 15: file << item.l_comment << "\n"; break;
         }
     }
+}
 
+// Row of the table kept in memory while sorting, with its key already extracted
+struct SortRow {
+    std::string key;
+    double numericKey;
     std::string line;
-    int rowCount = 0;
-    std::vector<LineItem> buffer;
-
-    while (std::getline(inFile, line)) {
-        if (!line.empty() && line.back() == '|') line.pop_back();
-        buffer.push_back(parseLineItem(line));
-        rowCount++;
-
-        if (rowCount == bufferSize / sizeof(LineItem)) {
-            // Parallelize writing columns
-            #pragma omp parallel for
-            for (int i = 0; i < 16; ++i) {
-                for (const auto &item : buffer) {
-                    switch (i) {
-                        case 0: columnFiles[i] << item.l_orderkey << "\n"; break;
-                        case 1: columnFiles[i] << item.l_partkey << "\n"; break;
-                        case 2: columnFiles[i] << item.l_suppkey << "\n"; break;
-                        case 3: columnFiles[i] << item.l_linenumber << "\n"; break;
-                        case 4: columnFiles[i] << item.l_quantity << "\n"; break;
-                        case 5: columnFiles[i] << item.l_extendedprice << "\n"; break;
-                        case 6: columnFiles[i] << item.l_discount << "\n"; break;
-                        case 7: columnFiles[i] << item.l_tax << "\n"; break;
-                        case 8: columnFiles[i] << item.l_returnflag << "\n"; break;
-                        case 9: columnFiles[i] << item.l_linestatus << "\n"; break;
-                        case 10: columnFiles[i] << item.l_shipDATE << "\n"; break;
-                        case 11: columnFiles[i] << item.l_commitDATE << "\n"; break;
-                        case 12: columnFiles[i] << item.l_receiptDATE << "\n"; break;
-                        case 13: columnFiles[i] << item.l_shipinstruct << "\n"; break;
-                        case 14: columnFiles[i] << item.l_shipmode << "\n"; break;
-                        case 15: columnFiles[i] << item.l_comment << "\n"; break;
-                    }
-                }
-            }
-            buffer.clear();
-            rowCount = 0;
-        }
+};
+
+// Value of a column in a full '|' separated line
+std::string fieldOf(const std::string &line, int column) {
+    size_t start = 0;
+    for (int i = 0; i < column; ++i) {
+        start = line.find('|', start) + 1;
     }
+    size_t end = line.find('|', start);
+    return line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
 
-    // Flush remaining rows
-    for (const auto &item : buffer) {
-        columnFiles[0] << item.l_orderkey << "\n";
-        columnFiles[1] << item.l_partkey << "\n";
-        columnFiles[2] << item.l_suppkey << "\n";
-        columnFiles[3] << item.l_linenumber << "\n";
-        columnFiles[4] << item.l_quantity << "\n";
-        columnFiles[5] << item.l_extendedprice << "\n";
-        columnFiles[6] << item.l_discount << "\n";
-        columnFiles[7] << item.l_tax << "\n";
-        columnFiles[8] << item.l_returnflag << "\n";
-        columnFiles[9] << item.l_linestatus << "\n";
-        columnFiles[10] << item.l_shipDATE << "\n";
-        columnFiles[11] << item.l_commitDATE << "\n";
-        columnFiles[12] << item.l_receiptDATE << "\n";
-        columnFiles[13] << item.l_shipinstruct << "\n";
-        columnFiles[14] << item.l_shipmode << "\n";
-        columnFiles[15] << item.l_comment << "\n";
+// Compare two rows by the sort columns; the first one is already extracted, the others only on ties
+bool sortRowLess(const SortRow &a, const SortRow &b, const std::vector<int> &sortColumns) {
+    if (isNumericColumn(sortColumns[0])) {
+        if (a.numericKey != b.numericKey) return a.numericKey < b.numericKey;
+    } else if (a.key != b.key) {
+        return a.key < b.key;
+    }
+    for (size_t i = 1; i < sortColumns.size(); ++i) {
+        std::string valueA = fieldOf(a.line, sortColumns[i]);
+        std::string valueB = fieldOf(b.line, sortColumns[i]);
+        if (columnValueLess(sortColumns[i], valueA, valueB)) return true;
+        if (columnValueLess(sortColumns[i], valueB, valueA)) return false;
     }
+    return false;
+}
+
+// Build a SortRow from a full '|' separated line
+SortRow makeSortRow(const std::string &line, int sortedColumnIndex) {
+    SortRow row;
+    row.key = fieldOf(line, sortedColumnIndex);
+    row.numericKey = isNumericColumn(sortedColumnIndex) ? std::stod(row.key) : 0.0;
+    row.line = line;
+    return row;
+}
+
+// Block of input lines flowing through the task graph
+struct LineBlock {
+    std::vector<std::string> lines;
+    std::vector<LineItem> items;
+    std::vector<long long> chunkEnds;
+};
+
+// Run being filled by the append tasks, then sorted in pieces and spilled
+struct RunBuffer {
+    std::vector<SortRow> rows;
+    LineChecksum checksum;
+};
 
-    for (auto &file : columnFiles) {
-        file.close();
+// Number of blocks in flight: reading, parsing and writing overlap on different blocks
+const int BLOCK_SLOTS = 4;
+
+// Merge the sorted pieces of a run into its run file; returns its size and checksum
+LineChecksum spillSortedPieces(std::vector<SortRow> &rows, int pieces, const std::vector<int> &sortColumns,
+                               const std::string &runFile) {
+    std::ofstream outFile(runFile);
+    if (!outFile.is_open()) {
+        std::cerr << "Error opening run file: " << runFile << std::endl;
+        exit(1);
     }
-    inFile.close();
+
+    std::vector<size_t> next(pieces), end(pieces);
+    for (int p = 0; p < pieces; ++p) {
+        next[p] = rows.size() * p / pieces;
+        end[p] = rows.size() * (p + 1) / pieces;
+    }
+    auto greater = [&](int a, int b) {
+        return sortRowLess(rows[next[b]], rows[next[a]], sortColumns);
+    };
+    std::priority_queue<int, std::vector<int>, decltype(greater)> heap(greater);
+    for (int p = 0; p < pieces; ++p) {
+        if (next[p] < end[p]) heap.push(p);
+    }
+    LineChecksum checksum;
+    while (!heap.empty()) {
+        int p = heap.top();
+        heap.pop();
+        outFile << rows[next[p]].line << "\n";
+        checksum.addLine(rows[next[p]].line);
+        if (++next[p] < end[p]) heap.push(p);
+    }
+
+    outFile.close();
+    return checksum;
 }
 
-// Sort a selected column chunk with OpenMP parallel sorting
-void sortSelectedColumnChunkWithMemory(const std::string &inputFile, const std::string &outputFile, int memorySize) {
-    std::ifstream inFile(inputFile);
-    std::vector<std::string> buffer;
-    std::string value;
-    int rowCount = 0;
-
-    while (std::getline(inFile, value)) {
-        buffer.push_back(value);
-        rowCount++;
-
-        if (rowCount == memorySize / sizeof(std::string)) {
-            #pragma omp parallel
-            {
-                #pragma omp single nowait
-                std::sort(buffer.begin(), buffer.end());
-            }
+// Split lineitem into the column chunks and sort its rows into runs, as one OpenMP task graph.
+// The reading thread reads blocks of about B / BLOCK_SLOTS bytes of LineItem and, for every block, creates:
+//   parse  ->  write column c (one task per column, in block order for each column)
+//          ->  append to the current run
+// and, when the current run reaches M / 2: sort piece p of the run (one task per thread)  ->  spill the run
+// -> checkpoint the run, once the chunks of its rows are written too.
+// Reading block N+1, writing the chunks of block N, sorting a run and spilling the previous one all overlap.
+// Threads are bound with proc_bind(close) (set OMP_PLACES to choose the places).
+// After an interruption, it resumes after the last checkpointed run, with the chunk files cut back to that run.
+std::vector<std::string> splitAndSortRunsWithTaskGraph(const std::string &inputFile,
+                                                       long long bufferSize,
+                                                       long long memorySize,
+                                                       const std::vector<int> &sortColumns,
+                                                       const std::string &tempDir) {
+    // Runs made before the sort was interrupted
+    const SortCheckpoint &checkpoint = sortCheckpoint();
+    std::vector<std::string> runFiles;
+    for (const auto &run : checkpoint.runs) {
+        runFiles.push_back(run.file);
+    }
+    if (checkpoint.runsDone) {
+        return runFiles;
+    }
+    long long resumeRow = checkpoint.runs.empty() ? 0 : checkpoint.runs.back().endRow;
+    bool writeChunks = !checkpoint.chunksDone;
 
-            std::ofstream outFile(outputFile, std::ios::app);
-            for (const auto &val : buffer) {
-                outFile << val << "\n";
+    MetricsPhase phase("split + run sort");
+    std::ifstream inFile(inputFile);
+    if (!inFile.is_open()) {
+        std::cerr << "Error opening LINEITEM file: " << inputFile << std::endl;
+        exit(1);
+    }
+    std::vector<std::ofstream> columnFiles(16);
+    for (int i = 0; i < 16 && writeChunks; ++i) {
+        std::string chunkFile = tempPath(tempDir, "chunk_col" + std::to_string(i + 1) + ".tbl");
+        if (resumeRow > 0) {
+            // Keep the rows of the checkpointed runs, drop what was written after them
+            if (truncate(chunkFile.c_str(), checkpoint.runs.back().chunkSizes[i]) != 0) {
+                std::cerr << "Error truncating file for column " << i + 1 << std::endl;
+                exit(1);
             }
-            outFile.close();
-            buffer.clear();
-            rowCount = 0;
+            columnFiles[i].open(chunkFile, std::ios::in | std::ios::out);
+            columnFiles[i].seekp(0, std::ios::end);
+        } else {
+            columnFiles[i].open(chunkFile);
+        }
+        if (!columnFiles[i].is_open()) {
+            std::cerr << "Error opening file for column " << i + 1 << std::endl;
+            exit(1);
+        }
+        // Keep the two decimals of l_extendedprice, l_discount and l_tax
+        if (i >= 5 && i <= 7) {
+            columnFiles[i] << std::fixed << std::setprecision(2);
         }
     }
+    std::vector<long long> chunkStart(16);
+    for (int i = 0; i < 16 && writeChunks; ++i) {
+        chunkStart[i] = columnFiles[i].tellp();
+    }
 
-    #pragma omp parallel
-    {
-        #pragma omp single nowait
-        std::sort(buffer.begin(), buffer.end());
+    // Skip the rows that are already in the runs
+    for (long long skipped = 0; skipped < resumeRow; ++skipped) {
+        inFile.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
     }
 
-    std::ofstream outFile(outputFile, std::ios::app);
-    for (const auto &val : buffer) {
-        outFile << val << "\n";
+    const size_t rowsPerBlock = std::max<size_t>(1, bufferSize / sizeof(LineItem) / BLOCK_SLOTS);
+    const long long runBudget = std::max(1LL, memorySize / 2);
+    const int pieces = omp_get_max_threads();
+    std::vector<LineBlock> blocks(BLOCK_SLOTS);
+    RunBuffer runs[2];
+    std::string lastRunFile;
+    const RunBuffer *lastRunBuffer = nullptr;
+    long long rowsRead = 0, bytesRead = 0, runBytesWritten = 0;
+
+    phase.beginParallel(omp_get_max_threads());
+    #pragma omp parallel proc_bind(close)
+    #pragma omp single
+    {
+        long long runBytes = 0;
+        int run = runFiles.size();
+
+        for (size_t blockIndex = 0;; ++blockIndex) {
+            LineBlock *block = &blocks[blockIndex % BLOCK_SLOTS];
+            RunBuffer *buffer = &runs[run % 2];
+
+            // Wait until the tasks of the block that used this slot before are done
+            #pragma omp taskwait depend(inout: block[0])
+
+            // Read the block (sequential I/O on this thread)
+            block->lines.clear();
+            std::string line;
+            while (block->lines.size() < rowsPerBlock && std::getline(inFile, line)) {
+                rowsRead++;
+                bytesRead += line.size() + 1;
+                if (!line.empty() && line.back() == '|') line.pop_back();
+                runBytes += sizeof(SortRow) + 2 * line.size();
+                block->lines.push_back(line);
+            }
+            bool lastBlock = block->lines.empty();
+            bool closesRun = runBytes > 0 && (runBytes >= runBudget || lastBlock);
+            long long endRow = resumeRow + rowsRead;
+
+            if (!lastBlock) {
+                #pragma omp task depend(inout: block[0]) firstprivate(block)
+                {
+                    double busyStart = phase.now();
+                    block->items.resize(block->lines.size());
+                    for (size_t i = 0; i < block->lines.size(); ++i) {
+                        block->items[i] = parseLineItem(block->lines[i]);
+                    }
+                    phase.threadDone(omp_get_thread_num(), busyStart);
+                }
+
+                block->chunkEnds.assign(writeChunks && closesRun ? 16 : 0, 0);
+                for (int c = 0; c < 16 && writeChunks; ++c) {
+                    std::ofstream *columnFile = &columnFiles[c];
+                    #pragma omp task depend(in: block[0]) depend(inout: columnFile[0]) firstprivate(block, columnFile, c, closesRun)
+                    {
+                        double busyStart = phase.now();
+                        writeColumnChunk(*columnFile, c, block->items);
+                        // The run checkpoint records how far the chunks are written
+                        if (closesRun) {
+                            columnFile->flush();
+                            block->chunkEnds[c] = columnFile->tellp();
+                        }
+                        phase.threadDone(omp_get_thread_num(), busyStart);
+                    }
+                }
+
+                #pragma omp task depend(in: block[0]) depend(inout: buffer[0]) firstprivate(block, buffer)
+                {
+                    double busyStart = phase.now();
+                    for (const auto &blockLine : block->lines) {
+                        buffer->rows.push_back(makeSortRow(blockLine, sortColumns[0]));
+                    }
+                    phase.threadDone(omp_get_thread_num(), busyStart);
+                }
+            }
+
+            // Close the run when it is full or the input ended: sort its pieces in parallel, then spill it
+            // while the next run fills the other buffer
+            if (closesRun) {
+                std::string runFile = tempPath(tempDir, "chunk_run" + std::to_string(run + 1) + ".tbl");
+                runFiles.push_back(runFile);
+
+                for (int p = 0; p < pieces; ++p) {
+                    #pragma omp task depend(in: buffer[0]) firstprivate(buffer, p)
+                    {
+                        double busyStart = phase.now();
+                        std::vector<SortRow> &rows = buffer->rows;
+                        std::sort(rows.begin() + rows.size() * p / pieces, rows.begin() + rows.size() * (p + 1) / pieces,
+                                  [&sortColumns](const SortRow &a, const SortRow &b) {
+                                      return sortRowLess(a, b, sortColumns);
+                                  });
+                        phase.threadDone(omp_get_thread_num(), busyStart);
+                    }
+                }
+
+                #pragma omp task depend(inout: buffer[0]) firstprivate(buffer, runFile)
+                {
+                    double busyStart = phase.now();
+                    buffer->checksum = spillSortedPieces(buffer->rows, pieces, sortColumns, runFile);
+                    #pragma omp atomic
+                    runBytesWritten += buffer->checksum.bytes;
+                    std::vector<SortRow>().swap(buffer->rows);
+                    phase.threadDone(omp_get_thread_num(), busyStart);
+                }
+
+                // The last run is checkpointed once the chunk files are closed
+                if (lastBlock) {
+                    lastRunFile = runFile;
+                    lastRunBuffer = buffer;
+                } else {
+                    // After the spill and the chunk writes of the block; checkpoints are written in the order of the runs
+                    #pragma omp task depend(in: buffer[0]) depend(inout: block[0]) depend(inout: sortCheckpoint().manifest) firstprivate(block, buffer, runFile, endRow)
+                    checkpointRun(runFile, endRow, buffer->checksum, block->chunkEnds);
+                }
+                run++;
+                runBytes = 0;
+            }
+            if (lastBlock) break;
+        }
+        #pragma omp taskwait
+    }
+    phase.endParallel();
+
+    long long columnBytes = 0;
+    std::vector<long long> chunkSizes;
+    for (int i = 0; i < 16 && writeChunks; ++i) {
+        chunkSizes.push_back(columnFiles[i].tellp());
+        columnBytes += chunkSizes.back() - chunkStart[i];
+        columnFiles[i].close();
     }
-    outFile.close();
     inFile.close();
+    if (!lastRunFile.empty()) {
+        checkpointRun(lastRunFile, resumeRow + rowsRead, lastRunBuffer->checksum, chunkSizes);
+    }
+    if (writeChunks) {
+        checkpointChunks(resumeRow + rowsRead, chunkSizes);
+    }
+    checkpointRunsDone();
+    phase.read(rowsRead, bytesRead);
+    phase.write(rowsRead, columnBytes + runBytesWritten);
+    metricsCount("runs", runFiles.size());
+    return runFiles;
 }
 
-void mergeChunksWithSortedColumn(const std::string &sortedColumnFile,
-                                  const std::vector<std::string> &columnFiles,
-                                  int sortedColumnIndex,
-                                  const std::string &outputFile) {
-    std::ifstream sortedFile(sortedColumnFile); // Coluna ordenada
-    std::vector<std::ifstream> columnStreams(columnFiles.size()); // Demais colunas
-
-    // Abrir todos os arquivos de coluna
-    for (size_t i = 0; i < columnFiles.size(); ++i) {
-        if (i == static_cast<size_t>(sortedColumnIndex)) {
-            continue; // Não abrir o arquivo da coluna ordenada
+// Run being read during the merge
+struct MergeSource {
+    std::ifstream stream;
+    SortRow row;
+};
+
+// Merge sorted runs into outputFile in one pass; the final pass also writes the sparse index (outputFile + ".idx").
+// Returns the checksum of an intermediate output, for its checkpoint.
+LineChecksum mergeRuns(const std::vector<std::string> &runFiles,
+               const std::vector<int> &sortColumns,
+               const std::string &outputFile,
+               bool writeIndex,
+               MetricsPhase &phase) {
+    std::vector<MergeSource> sources(runFiles.size());
+    auto greater = [&sources, &sortColumns](size_t a, size_t b) {
+        return sortRowLess(sources[b].row, sources[a].row, sortColumns);
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+
+    // Open every run and read its first row
+    std::string line;
+    for (size_t i = 0; i < runFiles.size(); ++i) {
+        sources[i].stream.open(runFiles[i]);
+        if (!sources[i].stream.is_open()) {
+            std::cerr << "Error opening run file: " << runFiles[i] << std::endl;
+            exit(1);
         }
-        columnStreams[i].open(columnFiles[i]);
-        if (!columnStreams[i].is_open()) {
-            std::cerr << "Erro ao abrir o arquivo de coluna: " << columnFiles[i] << std::endl;
-            return;
+        if (std::getline(sources[i].stream, line)) {
+            sources[i].row = makeSortRow(line, sortColumns[0]);
+            heap.push(i);
         }
     }
 
     std::ofstream outFile(outputFile);
-    if (!outFile.is_open()) {
-        std::cerr << "Erro ao abrir o arquivo de saída: " << outputFile << std::endl;
-        return;
+    std::ofstream indexFile;
+    if (writeIndex) {
+        indexFile.open(outputFile + ".idx");
+    }
+    if (!outFile.is_open() || (writeIndex && !indexFile.is_open())) {
+        std::cerr << "Error opening output file: " << outputFile << std::endl;
+        exit(1);
+    }
+    if (writeIndex) {
+        writeZoneMapHeader(indexFile, sortColumns[0]);
     }
 
-    std::string sortedValue;
-    std::vector<std::string> columnValues(columnFiles.size());
-
-    // Ler linha por linha
-    while (std::getline(sortedFile, sortedValue)) {
-        // Substituir a coluna escolhida pela ordenada
-        columnValues[sortedColumnIndex] = sortedValue;
-
-        // Ler as demais colunas
-        for (size_t i = 0; i < columnFiles.size(); ++i) {
-            if (i == static_cast<size_t>(sortedColumnIndex)) {
-                continue; // Ignorar a coluna já ordenada
+    ZoneMap zone;
+    LineChecksum checksum;
+    long long offset = 0, rows = 0;
+
+    // Always write the smallest row among the runs
+    while (!heap.empty()) {
+        size_t i = heap.top();
+        heap.pop();
+
+        const std::string &row = sources[i].row.line;
+        outFile << row << "\n";
+        if (writeIndex) {
+            updateZoneMap(zone, row, sortColumns[0], offset);
+            if (zone.rows == ZONE_MAP_BLOCK_ROWS) {
+                writeZoneMap(indexFile, zone);
             }
-            std::getline(columnStreams[i], columnValues[i]);
+        } else {
+            checksum.addLine(row);
         }
+        offset += row.size() + 1;
+        rows++;
 
-        // Escrever a linha combinada no arquivo de saída
-        for (size_t i = 0; i < columnValues.size(); ++i) {
-            outFile << columnValues[i];
-            if (i < columnValues.size() - 1) {
-                outFile << "|";
-            }
+        if (std::getline(sources[i].stream, line)) {
+            sources[i].row = makeSortRow(line, sortColumns[0]);
+            heap.push(i);
         }
-        outFile << "\n";
+    }
+    if (zone.rows > 0) {
+        writeZoneMap(indexFile, zone);
     }
 
-    // Fechar todos os arquivos
-    sortedFile.close();
-    for (auto &stream : columnStreams) {
-        if (stream.is_open()) {
-            stream.close();
-        }
+    // Close all files; the caller removes the runs once the merge is checkpointed
+    for (size_t i = 0; i < sources.size(); ++i) {
+        sources[i].stream.close();
     }
+    phase.read(rows, offset);
+    phase.write(rows, offset + (writeIndex ? static_cast<long long>(indexFile.tellp()) : 0));
     outFile.close();
+    if (writeIndex) {
+        indexFile.close();
+    }
+    metricsCount("merges", 1);
+    return checksum;
 }
 
-int main() {
-    int B_MB, M_GB, column;
-    std::cout << "Enter the size of the buffer [MB] (MAXIMUM 200): ";
-    std::cin >> B_MB;
-    std::cout << "Enter the size of the memory [MB]  (MAXIMUM 1024 (1GB)): ";
-    std::cin >> M_GB;
-    std::cout << "Enter the column to sort by (0 to 15): ";
-    std::cin >> column;
-
-    if (column < 0 || column >= 16) {
-        std::cerr << "Invalid column index!" << std::endl;
-        return 1;
+// Merge the sorted runs into the final table, at most fanIn runs at a time.
+// While there are more runs than fanIn, groups of fanIn runs are merged into longer runs (one pass each).
+void mergeChunksWithSortedColumn(std::vector<std::string> runFiles,
+                                 const std::vector<int> &sortColumns,
+                                 const std::string &outputFile,
+                                 int fanIn,
+                                 const std::string &tempDir) {
+    MetricsPhase phase("merge");
+    int pass = 0;
+    while (runFiles.size() > static_cast<size_t>(fanIn)) {
+        pass++;
+        std::vector<std::string> mergedRuns;
+        for (size_t first = 0; first < runFiles.size(); first += fanIn) {
+            size_t last = std::min(runFiles.size(), first + fanIn);
+            std::vector<std::string> group(runFiles.begin() + first, runFiles.begin() + last);
+            if (group.size() == 1) {
+                mergedRuns.push_back(group[0]);
+                continue;
+            }
+            int groupIndex = mergedRuns.size() + 1;
+            std::string mergedRun = tempPath(tempDir, "chunk_run_p" + std::to_string(pass) + "_" +
+                                                          std::to_string(groupIndex) + ".tbl");
+            // Merged before the sort was interrupted: only its runs may be left to remove
+            if (checkpointedMerge(pass, groupIndex) != mergedRun) {
+                LineChecksum checksum = mergeRuns(group, sortColumns, mergedRun, false, phase);
+                checkpointMerge(pass, groupIndex, mergedRun, checksum, group);
+            }
+            for (const auto &run : group) {
+                std::remove(run.c_str());
+            }
+            mergedRuns.push_back(mergedRun);
+        }
+        runFiles = mergedRuns;
+        metricsCount("merge passes", 1);
     }
-    if (M_GB > 1024 || M_GB < 0 || B_MB > 200 || B_MB < 0 || B_MB > M_GB) {
-        std::cerr << "Invalid buffer or memory size!" << std::endl;
-        return 1;
+    mergeRuns(runFiles, sortColumns, outputFile, true, phase);
+    metricsCount("merge passes", 1);
+    for (const auto &run : runFiles) {
+        std::remove(run.c_str());
     }
+}
 
-    int B = B_MB * 1024 * 1024;
-    int M = M_GB * 1024 * 1024;
+int main(int argc, char *argv[]) {
+    SortOptions options;
+    options.outputFile = "lineitem_sorted_OMP.tbl";
+    if (argc > 1 ? !parseSortOptions(argc, argv, options) : !readSortOptionsInteractively(options)) {
+        return 1;
+    }
+    if (options.threads > 0) {
+        omp_set_num_threads(options.threads);
+    }
+    metricsInit();
+    openSortCheckpoint(options, "omp");
 
     auto start = std::chrono::high_resolution_clock::now();
 
-    // Separar as colunas em arquivos de chunks
-    separateColumnsToChunksWithBuffer("TPC-H/dbgen/lineitem.tbl", B);
+    // Separar as colunas em arquivos de chunks e ordenar as linhas em runs, no mesmo grafo de tarefas
+    std::vector<std::string> runFiles = splitAndSortRunsWithTaskGraph(options.inputFile, options.bufferSize,
+                                                                      options.memorySize, options.sortColumns,
+                                                                      options.tempDir);
 
-    // Ordenar a coluna escolhida
-    std::string selectedColumnFile = "chunk_col" + std::to_string(column + 1) + ".tbl";
-    std::string sortedColumnFile = "chunk_col" + std::to_string(column + 1) + "_sorted.tbl";
-    sortSelectedColumnChunkWithMemory(selectedColumnFile, sortedColumnFile, M);
-
-    // Mesclar todas as colunas em uma tabela final com a coluna ordenada
-    std::vector<std::string> columnFiles = {
-        "chunk_col1.tbl", "chunk_col2.tbl", "chunk_col3.tbl", "chunk_col4.tbl",
-        "chunk_col5.tbl", "chunk_col6.tbl", "chunk_col7.tbl", "chunk_col8.tbl",
-        "chunk_col9.tbl", "chunk_col10.tbl", "chunk_col11.tbl", "chunk_col12.tbl",
-        "chunk_col13.tbl", "chunk_col14.tbl", "chunk_col15.tbl", "chunk_col16.tbl"
-    };
-    mergeChunksWithSortedColumn(sortedColumnFile, columnFiles, column, "lineitem_sorted_OMP.tbl");
+    // Mesclar as runs em uma tabela final ordenada, com o índice esparso
+    mergeChunksWithSortedColumn(runFiles, options.sortColumns, options.outputFile, options.mergeFanIn, options.tempDir);
+    closeSortCheckpoint();
 
     auto end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> elapsed = end - start;
 
-    std::cout << "Sorting by column " << column << " completed successfully.\n";
+    std::cout << "Sorting by column " << options.sortColumns[0] << " completed successfully.\n";
     std::cout << "Elapsed time: " << elapsed.count() << " seconds." << std::endl;
+    metricsReport();
 
     return 0;
 }
@@ -0,0 +1,368 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <unordered_map>
+#include <map>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <omp.h>
+
+// Partial aggregates of TPC-H Q1 for one group
+struct Aggregate {
+    double sumQty = 0;
+    double sumBasePrice = 0;
+    double sumDiscPrice = 0;
+    double sumCharge = 0;
+    double sumDiscount = 0;
+    long long count = 0;
+
+    void add(const Aggregate &other) {
+        sumQty += other.sumQty;
+        sumBasePrice += other.sumBasePrice;
+        sumDiscPrice += other.sumDiscPrice;
+        sumCharge += other.sumCharge;
+        sumDiscount += other.sumDiscount;
+        count += other.count;
+    }
+};
+
+// Columnar batch of lineitem, only with the columns used by the aggregation
+struct LineItemBatch {
+    std::vector<double> quantity;
+    std::vector<double> extendedprice;
+    std::vector<double> discount;
+    std::vector<double> tax;
+    std::vector<int> shipdate;
+    std::vector<int> groupId;
+    std::vector<std::string> groupKey;
+    std::vector<char> valid;
+    size_t size = 0;
+
+    void resize(size_t rows, bool withKeys) {
+        quantity.resize(rows);
+        extendedprice.resize(rows);
+        discount.resize(rows);
+        tax.resize(rows);
+        shipdate.resize(rows);
+        groupId.resize(rows);
+        valid.resize(rows);
+        if (withKeys) groupKey.resize(rows);
+        size = rows;
+    }
+};
+
+// Number of dense groups: one per (l_returnflag, l_linestatus) pair of bytes
+const int DENSE_GROUPS = 256 * 256;
+
+// Number of partitions used when the hash aggregation spills to disk
+const int SPILL_PARTITIONS = 64;
+
+// Convert a YYYY-MM-DD date into YYYYMMDD, so dates compare as integers
+int parseDate(const char *date) {
+    return std::atoi(date) * 10000 + std::atoi(date + 5) * 100 + std::atoi(date + 8);
+}
+
+// Parse one lineitem row into position i of the batch; false (and the row is left out) if it has fewer than 16 fields
+bool parseLineItemInto(const std::string &line, LineItemBatch &batch, size_t i,
+                       const std::vector<int> &groupColumns, bool dense) {
+    size_t starts[17];
+    starts[0] = 0;
+    for (int c = 1; c <= 16; ++c) {
+        size_t end = line.find('|', starts[c - 1]);
+        // The last field may end the line without its '|'
+        if (end == std::string::npos && c < 16) {
+            batch.valid[i] = 0;
+            return false;
+        }
+        starts[c] = (end == std::string::npos ? line.size() : end) + 1;
+    }
+    batch.valid[i] = 1;
+
+    const char *text = line.c_str();
+    batch.quantity[i] = std::strtod(text + starts[4], nullptr);
+    batch.extendedprice[i] = std::strtod(text + starts[5], nullptr);
+    batch.discount[i] = std::strtod(text + starts[6], nullptr);
+    batch.tax[i] = std::strtod(text + starts[7], nullptr);
+    batch.shipdate[i] = parseDate(text + starts[10]);
+
+    if (dense) {
+        // Group id from the first byte of l_returnflag and l_linestatus
+        int id = 0;
+        for (int column : groupColumns) {
+            id |= static_cast<unsigned char>(text[starts[column]]) << (column == 8 ? 8 : 0);
+        }
+        batch.groupId[i] = id;
+    } else {
+        std::string &key = batch.groupKey[i];
+        key.clear();
+        for (size_t g = 0; g < groupColumns.size(); ++g) {
+            int column = groupColumns[g];
+            if (g > 0) key += '|';
+            key.append(text + starts[column], starts[column + 1] - starts[column] - 1);
+        }
+    }
+    return true;
+}
+
+// Hash aggregation of one thread, spilling its partial aggregates when the memory budget is reached
+struct SpillingHashAggregation {
+    std::unordered_map<std::string, Aggregate> groups;
+    long long memoryBudget;
+    long long memoryUsed = 0;
+    std::vector<std::string> spillFiles;
+    int spills = 0;
+
+    SpillingHashAggregation(long long budget, int thread) : memoryBudget(budget) {
+        for (int p = 0; p < SPILL_PARTITIONS; ++p) {
+            spillFiles.push_back("agg_spill_t" + std::to_string(thread) + "_p" + std::to_string(p) + ".tbl");
+        }
+    }
+
+    Aggregate &find(const std::string &key) {
+        auto it = groups.find(key);
+        if (it != groups.end()) return it->second;
+
+        // Rough size of a new entry: key, aggregates and the hash node
+        memoryUsed += key.size() + sizeof(Aggregate) + 64;
+        if (memoryUsed > memoryBudget && !groups.empty()) {
+            spill();
+        }
+        return groups[key];
+    }
+
+    // Write the partial aggregates into the partition files and free the hash table
+    void spill() {
+        std::vector<std::ofstream> partitions(SPILL_PARTITIONS);
+        for (int p = 0; p < SPILL_PARTITIONS; ++p) {
+            partitions[p].open(spillFiles[p], spills == 0 ? std::ios::trunc : std::ios::app);
+            partitions[p] << std::setprecision(17);
+        }
+        std::hash<std::string> hasher;
+        for (const auto &entry : groups) {
+            const Aggregate &a = entry.second;
+            partitions[hasher(entry.first) % SPILL_PARTITIONS]
+                << entry.first << "#" << a.sumQty << "#" << a.sumBasePrice << "#" << a.sumDiscPrice << "#"
+                << a.sumCharge << "#" << a.sumDiscount << "#" << a.count << "\n";
+        }
+        groups.clear();
+        memoryUsed = 0;
+        spills++;
+    }
+};
+
+// Read one spilled partial aggregate line: key#sumQty#sumBasePrice#sumDiscPrice#sumCharge#sumDiscount#count
+void readSpilledAggregate(const std::string &line, std::string &key, Aggregate &a) {
+    size_t end = line.rfind('#');
+    a.count = std::stoll(line.substr(end + 1));
+    double *sums[] = {&a.sumDiscount, &a.sumCharge, &a.sumDiscPrice, &a.sumBasePrice, &a.sumQty};
+    for (double *sum : sums) {
+        size_t start = line.rfind('#', end - 1);
+        *sum = std::stod(line.substr(start + 1, end - start - 1));
+        end = start;
+    }
+    key = line.substr(0, end);
+}
+
+// Aggregate a batch: first compute the derived values in a vectorizable loop, then add them to the groups of the thread
+void aggregateBatch(const LineItemBatch &batch, int cutoffDate, bool dense,
+                    std::vector<std::vector<Aggregate>> &denseGroups,
+                    std::vector<SpillingHashAggregation> &hashGroups,
+                    std::vector<double> &discPrice, std::vector<double> &charge) {
+    const size_t rows = batch.size;
+    discPrice.resize(rows);
+    charge.resize(rows);
+
+    #pragma omp parallel
+    {
+        int thread = omp_get_thread_num();
+
+        #pragma omp for simd schedule(static)
+        for (size_t i = 0; i < rows; ++i) {
+            discPrice[i] = batch.extendedprice[i] * (1.0 - batch.discount[i]);
+            charge[i] = discPrice[i] * (1.0 + batch.tax[i]);
+        }
+
+        #pragma omp for schedule(static)
+        for (size_t i = 0; i < rows; ++i) {
+            if (!batch.valid[i] || batch.shipdate[i] > cutoffDate) continue;
+
+            Aggregate &a = dense ? denseGroups[thread][batch.groupId[i]] : hashGroups[thread].find(batch.groupKey[i]);
+            a.sumQty += batch.quantity[i];
+            a.sumBasePrice += batch.extendedprice[i];
+            a.sumDiscPrice += discPrice[i];
+            a.sumCharge += charge[i];
+            a.sumDiscount += batch.discount[i];
+            a.count++;
+        }
+    }
+}
+
+// Merge the partial aggregates of every thread (and of every spilled partition) into the final groups
+std::map<std::string, Aggregate> mergePartialAggregates(bool dense, const std::vector<int> &groupColumns,
+                                                        std::vector<std::vector<Aggregate>> &denseGroups,
+                                                        std::vector<SpillingHashAggregation> &hashGroups,
+                                                        std::ofstream &outFile) {
+    std::map<std::string, Aggregate> result;
+
+    if (dense) {
+        for (int id = 0; id < DENSE_GROUPS; ++id) {
+            Aggregate total;
+            for (const auto &groups : denseGroups) total.add(groups[id]);
+            if (total.count == 0) continue;
+
+            std::string key;
+            for (size_t g = 0; g < groupColumns.size(); ++g) {
+                if (g > 0) key += '|';
+                key += static_cast<char>(groupColumns[g] == 8 ? id >> 8 : id & 0xff);
+            }
+            result[key] = total;
+        }
+        return result;
+    }
+
+    bool spilled = false;
+    for (const auto &groups : hashGroups) spilled = spilled || groups.spills > 0;
+    if (!spilled) {
+        for (const auto &groups : hashGroups) {
+            for (const auto &entry : groups.groups) result[entry.first].add(entry.second);
+        }
+        return result;
+    }
+
+    // Spill what is still in memory, then aggregate one partition at a time and stream it to the output
+    for (auto &groups : hashGroups) groups.spill();
+    std::string line, key;
+    for (int p = 0; p < SPILL_PARTITIONS; ++p) {
+        std::unordered_map<std::string, Aggregate> partition;
+        for (const auto &groups : hashGroups) {
+            std::ifstream spillFile(groups.spillFiles[p]);
+            while (std::getline(spillFile, line)) {
+                Aggregate a;
+                readSpilledAggregate(line, key, a);
+                partition[key].add(a);
+            }
+            spillFile.close();
+            std::remove(groups.spillFiles[p].c_str());
+        }
+        std::map<std::string, Aggregate> sorted(partition.begin(), partition.end());
+        for (const auto &entry : sorted) {
+            const Aggregate &a = entry.second;
+            outFile << entry.first << "|" << a.sumQty << "|" << a.sumBasePrice << "|" << a.sumDiscPrice << "|"
+                    << a.sumCharge << "|" << a.sumQty / a.count << "|" << a.sumBasePrice / a.count << "|"
+                    << a.sumDiscount / a.count << "|" << a.count << "\n";
+        }
+    }
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 5) {
+        std::cerr << "Usage: " << argv[0] << " <lineitem.tbl> <max l_shipdate> <buffer MB> <memory MB> [group column ...]" << std::endl;
+        std::cerr << "Example (TPC-H Q1): " << argv[0] << " TPC-H/dbgen/lineitem.tbl 1998-09-02 64 1024 8 9" << std::endl;
+        return 1;
+    }
+
+    std::string inputFile = argv[1];
+    int cutoffDate = parseDate(argv[2]);
+    long long B = std::stoll(argv[3]) * 1024 * 1024;
+    long long M = std::stoll(argv[4]) * 1024 * 1024;
+    std::vector<int> groupColumns;
+    for (int i = 5; i < argc; ++i) groupColumns.push_back(std::stoi(argv[i]));
+    if (groupColumns.empty()) groupColumns = {8, 9};
+
+    for (int column : groupColumns) {
+        if (column < 0 || column >= 16) {
+            std::cerr << "Invalid column index!" << std::endl;
+            return 1;
+        }
+    }
+    if (B <= 0 || M <= 0 || B > M) {
+        std::cerr << "Invalid buffer or memory size!" << std::endl;
+        return 1;
+    }
+
+    // l_returnflag and l_linestatus are single characters: their groups fit in a dense array
+    bool dense = std::all_of(groupColumns.begin(), groupColumns.end(), [](int c) { return c == 8 || c == 9; }) &&
+                 std::count(groupColumns.begin(), groupColumns.end(), 8) <= 1 &&
+                 std::count(groupColumns.begin(), groupColumns.end(), 9) <= 1;
+
+    std::ifstream inFile(inputFile);
+    if (!inFile.is_open()) {
+        std::cerr << "Error opening LINEITEM file." << std::endl;
+        return 1;
+    }
+    std::ofstream outFile("aggregate_results.tbl");
+    if (!outFile.is_open()) {
+        std::cerr << "Error opening output file." << std::endl;
+        return 1;
+    }
+    outFile << std::fixed << std::setprecision(2);
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    int threads = omp_get_max_threads();
+    std::vector<std::vector<Aggregate>> denseGroups;
+    std::vector<SpillingHashAggregation> hashGroups;
+    if (dense) {
+        denseGroups.assign(threads, std::vector<Aggregate>(DENSE_GROUPS));
+    } else {
+        // The hash tables share the memory budget with the batch, as in the external sort
+        for (int t = 0; t < threads; ++t) hashGroups.emplace_back((M - B) / threads, t);
+    }
+
+    // Read batches of B bytes worth of lines, parse them in parallel and aggregate them
+    std::vector<std::string> lines;
+    LineItemBatch batch;
+    std::vector<double> discPrice, charge;
+    std::string line;
+    long long batchBytes = 0;
+    bool more = true;
+
+    while (more) {
+        lines.clear();
+        batchBytes = 0;
+        while (batchBytes < B && (more = static_cast<bool>(std::getline(inFile, line)))) {
+            if (line.empty()) continue;
+            batchBytes += line.size() + sizeof(std::string);
+            lines.push_back(line);
+        }
+        if (lines.empty()) break;
+
+        batch.resize(lines.size(), !dense);
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < lines.size(); ++i) {
+            if (!parseLineItemInto(lines[i], batch, i, groupColumns, dense)) {
+                #pragma omp critical
+                std::cerr << "Malformed LINEITEM row: " << lines[i] << std::endl;
+            }
+        }
+        aggregateBatch(batch, cutoffDate, dense, denseGroups, hashGroups, discPrice, charge);
+    }
+    inFile.close();
+
+    std::map<std::string, Aggregate> result = mergePartialAggregates(dense, groupColumns, denseGroups, hashGroups, outFile);
+
+    // Groups that fit in memory are written and printed ordered by their key, as in Q1
+    for (const auto &entry : result) {
+        const Aggregate &a = entry.second;
+        std::ostringstream row;
+        row << std::fixed << std::setprecision(2)
+            << entry.first << "|" << a.sumQty << "|" << a.sumBasePrice << "|" << a.sumDiscPrice << "|"
+            << a.sumCharge << "|" << a.sumQty / a.count << "|" << a.sumBasePrice / a.count << "|"
+            << a.sumDiscount / a.count << "|" << a.count << "\n";
+        outFile << row.str();
+        std::cout << row.str();
+    }
+    outFile.close();
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    std::cout << "Elapsed time: " << elapsed.count() << " seconds." << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,456 @@
+// Benchmark of every stage of the first and second parts, serial and OMP, on generated TPC-H tables.
+// The programs are included in their own namespace, so the benchmark times the real stage functions.
+// All the headers they use are included first, so their own includes are skipped.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <unordered_map>
+#include <chrono>
+#include <queue>
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <omp.h>
+#include <unistd.h>
+#include "metrics.h"
+#include "sort_options.h"
+#include "checkpoint.h"
+#include "zone_map.h"
+
+namespace serial_join {
+#include "project_1stpart.cpp"
+}
+namespace omp_join {
+#include "OMP_1stpart.cpp"
+}
+namespace serial_sort {
+#include "project_2ndpart.cpp"
+}
+namespace omp_sort {
+#include "OMP_2ndpart.cpp"
+}
+
+// Deterministic generator (64-bit LCG): the same seed gives the same tables on every machine and compiler
+struct Random {
+    unsigned long long state;
+
+    explicit Random(unsigned long long seed) : state(seed * 6364136223846793005ULL + 1442695040888963407ULL) {}
+
+    unsigned long long next() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return state >> 33;
+    }
+
+    long long between(long long low, long long high) {
+        return low + static_cast<long long>(next() % static_cast<unsigned long long>(high - low + 1));
+    }
+
+    template <size_t N>
+    const char *pick(const char *const (&words)[N]) {
+        return words[next() % N];
+    }
+};
+
+const char *const COLORS[] = {
+    "almond", "antique", "aquamarine", "azure", "beige", "bisque", "black", "blanched", "blue", "blush",
+    "brown", "burlywood", "burnished", "chartreuse", "chiffon", "chocolate", "coral", "cornflower", "cornsilk", "cream",
+    "cyan", "dark", "deep", "dim", "dodger", "drab", "firebrick", "floral", "forest", "frosted",
+    "gainsboro", "ghost", "goldenrod", "green", "grey", "honeydew", "hot", "indian", "ivory", "khaki",
+    "lace", "lavender", "lawn", "lemon", "light", "lime", "linen", "magenta", "maroon", "medium",
+    "metallic", "midnight", "mint", "misty", "moccasin", "navajo", "navy", "olive", "orange", "orchid",
+    "pale", "papaya", "peach", "peru", "pink", "plum", "powder", "puff", "purple", "red",
+    "rose", "rosy", "royal", "saddle", "salmon", "sandy", "seashell", "sienna", "sky", "slate",
+    "smoke", "snow", "spring", "steel", "tan", "thistle", "tomato", "turquoise", "violet", "wheat",
+    "white", "yellow"};
+const char *const TYPE_SIZES[] = {"STANDARD", "SMALL", "MEDIUM", "LARGE", "ECONOMY", "PROMO"};
+const char *const TYPE_FINISHES[] = {"ANODIZED", "BURNISHED", "PLATED", "POLISHED", "BRUSHED"};
+const char *const TYPE_MATERIALS[] = {"TIN", "NICKEL", "BRASS", "STEEL", "COPPER"};
+const char *const CONTAINER_SIZES[] = {"SM", "LG", "MED", "JUMBO", "WRAP"};
+const char *const CONTAINER_TYPES[] = {"CASE", "BOX", "BAG", "JAR", "PKG", "PACK", "CAN", "DRUM"};
+const char *const SHIP_INSTRUCTIONS[] = {"DELIVER IN PERSON", "COLLECT COD", "NONE", "TAKE BACK RETURN"};
+const char *const SHIP_MODES[] = {"REG AIR", "AIR", "RAIL", "SHIP", "TRUCK", "MAIL", "FOB"};
+const char *const COMMENT_WORDS[] = {
+    "furiously", "sly", "careful", "blithe", "quick", "fluffy", "slow", "quiet", "ruthless", "thin",
+    "close", "dogged", "daring", "brave", "stealthy", "permanent", "enticing", "idle", "busy", "regular",
+    "final", "ironic", "even", "bold", "silent", "packages", "requests", "accounts", "deposits", "foxes",
+    "ideas", "theodolites", "pinto", "beans", "instructions", "dependencies", "excuses", "platelets", "asymptotes", "courts",
+    "dolphins", "sleep", "wake", "are", "cajole", "haggle", "nag", "use", "boost", "affix",
+    "detect", "integrate", "maintain", "nod", "was", "lose", "sublate", "solve", "thrash", "promise"};
+
+// Random text between minLength and maxLength characters, made of comment words
+std::string randomText(Random &random, int minLength, int maxLength) {
+    size_t length = random.between(minLength, maxLength);
+    std::string text;
+    while (text.size() < length) {
+        if (!text.empty()) text += ' ';
+        text += random.pick(COMMENT_WORDS);
+    }
+    text.resize(length);
+    return text;
+}
+
+// Days since 1970-01-01 of a civil date, and back (proleptic Gregorian calendar)
+long long daysFromCivil(long long y, long long m, long long d) {
+    y -= m <= 2;
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    long long yoe = y - era * 400;
+    long long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+std::string civilFromDays(long long z) {
+    z += 719468;
+    long long era = (z >= 0 ? z : z - 146096) / 146097;
+    long long doe = z - era * 146097;
+    long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long long mp = (5 * doy + 2) / 153;
+    long long d = doy - (153 * mp + 2) / 5 + 1;
+    long long m = mp + (mp < 10 ? 3 : -9);
+    long long y = yoe + era * 400 + (m <= 2);
+    char date[64];
+    std::snprintf(date, sizeof(date), "%04lld-%02lld-%02lld", y, m, d);
+    return date;
+}
+
+// p_retailprice as defined by TPC-H, in cents
+long long retailPriceCents(long long partkey) {
+    return 90000 + ((partkey / 10) % 20001) + 100 * (partkey % 1000);
+}
+
+// i-th supplier (0 to 3) of a part, as defined by TPC-H
+long long supplierOfPart(long long partkey, long long i, long long suppliers) {
+    return (partkey + (i * (suppliers / 4 + (partkey - 1) / suppliers))) % suppliers + 1;
+}
+
+struct GeneratedTables {
+    long long partRows = 0;
+    long long partsuppRows = 0;
+    long long lineitemRows = 0;
+};
+
+// Generate part, partsupp and lineitem at the given scale factor, in the dbgen .tbl format
+GeneratedTables generateTables(double scaleFactor, unsigned long long seed, const std::string &prefix) {
+    GeneratedTables tables;
+    long long parts = std::max(1LL, static_cast<long long>(200000 * scaleFactor));
+    long long suppliers = std::max(4LL, static_cast<long long>(10000 * scaleFactor));
+    long long orders = std::max(1LL, static_cast<long long>(1500000 * scaleFactor));
+    char number[64];
+
+    // PART
+    Random partRandom(seed * 3 + 1);
+    std::ofstream partFile(prefix + "part.tbl");
+    for (long long partkey = 1; partkey <= parts; ++partkey) {
+        long long m = partRandom.between(1, 5);
+        std::snprintf(number, sizeof(number), "%.2f", retailPriceCents(partkey) / 100.0);
+        partFile << partkey << "|";
+        for (int w = 0; w < 5; ++w) partFile << (w ? " " : "") << partRandom.pick(COLORS);
+        partFile << "|Manufacturer#" << m << "|Brand#" << m << partRandom.between(1, 5) << "|"
+                 << partRandom.pick(TYPE_SIZES) << " " << partRandom.pick(TYPE_FINISHES) << " "
+                 << partRandom.pick(TYPE_MATERIALS) << "|" << partRandom.between(1, 50) << "|"
+                 << partRandom.pick(CONTAINER_SIZES) << " " << partRandom.pick(CONTAINER_TYPES) << "|"
+                 << number << "|" << randomText(partRandom, 5, 22) << "|\n";
+        tables.partRows++;
+    }
+    partFile.close();
+
+    // PARTSUPP: four suppliers per part
+    Random partsuppRandom(seed * 3 + 2);
+    std::ofstream partsuppFile(prefix + "partsupp.tbl");
+    for (long long partkey = 1; partkey <= parts; ++partkey) {
+        for (long long i = 0; i < 4; ++i) {
+            std::snprintf(number, sizeof(number), "%.2f", partsuppRandom.between(100, 100000) / 100.0);
+            partsuppFile << partkey << "|" << supplierOfPart(partkey, i, suppliers) << "|"
+                         << partsuppRandom.between(1, 9999) << "|" << number << "|"
+                         << randomText(partsuppRandom, 49, 198) << "|\n";
+            tables.partsuppRows++;
+        }
+    }
+    partsuppFile.close();
+
+    // LINEITEM: 1 to 7 lines per order, sparse order keys (8 used out of every 32)
+    Random lineitemRandom(seed * 3 + 3);
+    std::ofstream lineitemFile(prefix + "lineitem.tbl");
+    const long long startDate = daysFromCivil(1992, 1, 1);
+    const long long endDate = daysFromCivil(1998, 12, 31);
+    const long long currentDate = daysFromCivil(1995, 6, 17);
+    char prices[96];
+    for (long long order = 0; order < orders; ++order) {
+        long long orderkey = (order / 8) * 32 + order % 8 + 1;
+        long long orderDate = lineitemRandom.between(startDate, endDate - 151);
+        long long lines = lineitemRandom.between(1, 7);
+        for (long long linenumber = 1; linenumber <= lines; ++linenumber) {
+            long long partkey = lineitemRandom.between(1, parts);
+            long long suppkey = supplierOfPart(partkey, lineitemRandom.between(0, 3), suppliers);
+            long long quantity = lineitemRandom.between(1, 50);
+            long long discount = lineitemRandom.between(0, 10);
+            long long tax = lineitemRandom.between(0, 8);
+            long long shipDate = orderDate + lineitemRandom.between(1, 121);
+            long long commitDate = orderDate + lineitemRandom.between(30, 90);
+            long long receiptDate = shipDate + lineitemRandom.between(1, 30);
+            char returnflag = receiptDate <= currentDate ? (lineitemRandom.between(0, 1) ? 'R' : 'A') : 'N';
+            char linestatus = shipDate > currentDate ? 'O' : 'F';
+
+            std::snprintf(prices, sizeof(prices), "%.2f|%.2f|%.2f",
+                          quantity * retailPriceCents(partkey) / 100.0, discount / 100.0, tax / 100.0);
+            lineitemFile << orderkey << "|" << partkey << "|" << suppkey << "|" << linenumber << "|"
+                         << quantity << "|" << prices << "|" << returnflag << "|" << linestatus << "|"
+                         << civilFromDays(shipDate) << "|" << civilFromDays(commitDate) << "|"
+                         << civilFromDays(receiptDate) << "|" << lineitemRandom.pick(SHIP_INSTRUCTIONS) << "|"
+                         << lineitemRandom.pick(SHIP_MODES) << "|" << randomText(lineitemRandom, 10, 43) << "|\n";
+            tables.lineitemRows++;
+        }
+    }
+    lineitemFile.close();
+
+    return tables;
+}
+
+// One measurement of the benchmark
+struct StageResult {
+    std::string variant;
+    int threads;
+    int bufferMB;
+    int memoryMB;
+    std::string stage;
+    long long rows;
+    double seconds;
+};
+
+// Time a stage, keeping the best of `repeat` runs
+template <typename Stage>
+double timeStage(int repeat, Stage stage) {
+    double best = 0;
+    for (int r = 0; r < repeat; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        stage();
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        if (r == 0 || seconds < best) best = seconds;
+    }
+    return best;
+}
+
+// Stages of the first part: hash build (load PART into the map), then probe + output (PARTSUPP join)
+template <typename Part, typename LoadPart, typename ProcessPartSupp>
+void benchmarkJoin(const std::string &variant, int threads, int repeat, const std::string &prefix,
+                   const GeneratedTables &tables, LoadPart loadPartTable, ProcessPartSupp processPartSupp,
+                   std::vector<StageResult> &results) {
+    std::unordered_map<int, Part> partMap;
+    double build = timeStage(repeat, [&]() { partMap = loadPartTable(prefix + "part.tbl"); });
+    results.push_back({variant, threads, 0, 0, "hash build", tables.partRows, build});
+
+    double probe = timeStage(repeat, [&]() { processPartSupp(prefix + "partsupp.tbl", partMap, prefix + "join.tbl"); });
+    results.push_back({variant, threads, 0, 0, "probe + output", tables.partsuppRows, probe});
+}
+
+// Best time of each stage measured by a split + run sort function, in the order of the stages
+typedef std::vector<std::pair<std::string, double>> StageTimes;
+
+// Stages of the second part: parse, split into column chunks, run sort, merge (+ sparse index).
+// The OMP program runs the split and the run sort as one task graph, so its variant times them as one stage.
+template <typename ParseLineItem, typename SplitAndSortRuns, typename Merge>
+void benchmarkSort(const std::string &variant, int threads, int bufferMB, int memoryMB, int column, int repeat,
+                   const std::string &prefix, const GeneratedTables &tables,
+                   ParseLineItem parseLineItem, SplitAndSortRuns splitAndSortRuns, Merge mergeChunksWithSortedColumn,
+                   std::vector<StageResult> &results) {
+    long long B = bufferMB * MB;
+    long long M = memoryMB * MB;
+    std::vector<int> sortColumns = {column};
+
+    // Parse alone: read and parse every row without writing anything
+    double parse = timeStage(repeat, [&]() {
+        std::ifstream inFile(prefix + "lineitem.tbl");
+        std::string line;
+        long long checksum = 0;
+        while (std::getline(inFile, line)) {
+            if (!line.empty() && line.back() == '|') line.pop_back();
+            checksum += parseLineItem(line).l_orderkey;
+        }
+        if (checksum == 0) std::cerr << "Empty LINEITEM file." << std::endl;
+    });
+    results.push_back({variant, threads, bufferMB, memoryMB, "parse", tables.lineitemRows, parse});
+
+    // Every merge consumes its runs, so each repetition splits and sorts again
+    StageTimes best;
+    for (int r = 0; r < repeat; ++r) {
+        StageTimes times;
+        std::vector<std::string> runFiles = splitAndSortRuns(prefix + "lineitem.tbl", B, M, sortColumns, times);
+        times.push_back({"merge", timeStage(1, [&]() {
+            mergeChunksWithSortedColumn(runFiles, sortColumns, prefix + "sorted.tbl", autoMergeFanIn(M), ".");
+        })});
+        if (r == 0) best = times;
+        for (size_t i = 0; i < times.size(); ++i) best[i].second = std::min(best[i].second, times[i].second);
+    }
+    for (const auto &stage : best) {
+        results.push_back({variant, threads, bufferMB, memoryMB, stage.first, tables.lineitemRows, stage.second});
+    }
+}
+
+// Split then run sort of the serial program, timed one after the other
+std::vector<std::string> serialSplitAndSortRuns(const std::string &inputFile, long long B, long long M,
+                                                const std::vector<int> &sortColumns, StageTimes &times) {
+    std::vector<std::string> columnFiles;
+    for (int i = 1; i <= 16; ++i) columnFiles.push_back("chunk_col" + std::to_string(i) + ".tbl");
+    times.push_back({"split", timeStage(1, [&]() { serial_sort::separateColumnsToChunksWithBuffer(inputFile, B, "."); })});
+    std::vector<std::string> runFiles;
+    times.push_back({"run sort", timeStage(1, [&]() {
+        runFiles = serial_sort::sortSelectedColumnChunkWithMemory(columnFiles, sortColumns, M, ".");
+    })});
+    return runFiles;
+}
+
+// Split and run sort of the OMP program, as one task graph
+std::vector<std::string> ompSplitAndSortRuns(const std::string &inputFile, long long B, long long M,
+                                             const std::vector<int> &sortColumns, StageTimes &times) {
+    std::vector<std::string> runFiles;
+    times.push_back({"split+run sort", timeStage(1, [&]() {
+        runFiles = omp_sort::splitAndSortRunsWithTaskGraph(inputFile, B, M, sortColumns, ".");
+    })});
+    return runFiles;
+}
+
+// Parse a comma separated list of integers, e.g. "1,2,4"
+std::vector<int> parseList(const std::string &text) {
+    std::vector<int> values;
+    std::stringstream ss(text);
+    std::string value;
+    while (std::getline(ss, value, ',')) {
+        values.push_back(std::stoi(value));
+    }
+    return values;
+}
+
+void writeJson(const std::string &file, double scaleFactor, unsigned long long seed, const GeneratedTables &tables,
+               const std::vector<StageResult> &results) {
+    std::ofstream out(file);
+    out << "{\n  \"scale_factor\": " << scaleFactor << ",\n  \"seed\": " << seed
+        << ",\n  \"rows\": {\"part\": " << tables.partRows << ", \"partsupp\": " << tables.partsuppRows
+        << ", \"lineitem\": " << tables.lineitemRows << "},\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const StageResult &r = results[i];
+        out << "    {\"variant\": \"" << r.variant << "\", \"threads\": " << r.threads
+            << ", \"buffer_mb\": " << r.bufferMB << ", \"memory_mb\": " << r.memoryMB
+            << ", \"stage\": \"" << r.stage << "\", \"rows\": " << r.rows
+            << ", \"seconds\": " << std::setprecision(6) << r.seconds << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    out.close();
+}
+
+void writeCsv(const std::string &file, const std::vector<StageResult> &results) {
+    std::ofstream out(file);
+    out << "variant,threads,buffer_mb,memory_mb,stage,rows,seconds\n";
+    for (const auto &r : results) {
+        out << r.variant << "," << r.threads << "," << r.bufferMB << "," << r.memoryMB << ","
+            << r.stage << "," << r.rows << "," << std::setprecision(6) << r.seconds << "\n";
+    }
+    out.close();
+}
+
+int main(int argc, char *argv[]) {
+    double scaleFactor = 0.1;
+    unsigned long long seed = 42;
+    std::vector<int> threadCounts = {1, omp_get_max_threads()};
+    std::vector<int> memoriesMB = {64, 256};
+    int bufferMB = 16;
+    int column = 10;
+    int repeat = 1;
+    std::string jsonFile = "benchmark_results.json";
+    std::string csvFile = "benchmark_results.csv";
+    bool keepData = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--keep-data") {
+            keepData = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Usage: " << argv[0] << " [--sf 0.1] [--seed 42] [--threads 1,4] [--memory 64,256]"
+                      << " [--buffer 16] [--column 10] [--repeat 1] [--json file] [--csv file] [--keep-data]" << std::endl;
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (option == "--sf") scaleFactor = std::stod(value);
+        else if (option == "--seed") seed = std::stoull(value);
+        else if (option == "--threads") threadCounts = parseList(value);
+        else if (option == "--memory") memoriesMB = parseList(value);
+        else if (option == "--buffer") bufferMB = std::stoi(value);
+        else if (option == "--column") column = std::stoi(value);
+        else if (option == "--repeat") repeat = std::stoi(value);
+        else if (option == "--json") jsonFile = value;
+        else if (option == "--csv") csvFile = value;
+        else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return 1;
+        }
+    }
+
+    if (scaleFactor <= 0 || column < 0 || column >= 16 || repeat < 1 || threadCounts.empty() || memoriesMB.empty()) {
+        std::cerr << "Invalid benchmark parameters!" << std::endl;
+        return 1;
+    }
+    for (int memoryMB : memoriesMB) {
+        if (bufferMB < 1 || bufferMB > memoryMB) {
+            std::cerr << "Invalid buffer or memory size!" << std::endl;
+            return 1;
+        }
+    }
+
+    const std::string prefix = "bench_";
+    std::vector<StageResult> results;
+
+    GeneratedTables tables;
+    double generate = timeStage(1, [&]() { tables = generateTables(scaleFactor, seed, prefix); });
+    results.push_back({"generator", 1, 0, 0, "generate", tables.partRows + tables.partsuppRows + tables.lineitemRows, generate});
+    std::cout << "Generated SF " << scaleFactor << ": " << tables.partRows << " part, " << tables.partsuppRows
+              << " partsupp, " << tables.lineitemRows << " lineitem rows." << std::endl;
+
+    // First part
+    benchmarkJoin<serial_join::Part>("serial", 1, repeat, prefix, tables,
+                                     serial_join::loadPartTable, serial_join::processPartSupp, results);
+    for (int threads : threadCounts) {
+        omp_set_num_threads(threads);
+        benchmarkJoin<omp_join::Part>("omp", threads, repeat, prefix, tables,
+                                      omp_join::loadPartTable, omp_join::processPartSupp, results);
+    }
+
+    // Second part, for every memory size
+    for (int memoryMB : memoriesMB) {
+        benchmarkSort("serial", 1, bufferMB, memoryMB, column, repeat, prefix, tables,
+                      serial_sort::parseLineItem, serialSplitAndSortRuns, serial_sort::mergeChunksWithSortedColumn,
+                      results);
+        for (int threads : threadCounts) {
+            omp_set_num_threads(threads);
+            benchmarkSort("omp", threads, bufferMB, memoryMB, column, repeat, prefix, tables,
+                          omp_sort::parseLineItem, ompSplitAndSortRuns, omp_sort::mergeChunksWithSortedColumn,
+                          results);
+        }
+    }
+
+    for (const auto &r : results) {
+        std::cout << std::left << std::setw(10) << r.variant << std::setw(4) << r.threads
+                  << std::setw(6) << r.bufferMB << std::setw(6) << r.memoryMB << std::setw(16) << r.stage
+                  << std::setw(12) << r.rows << r.seconds << " s" << std::endl;
+    }
+    writeJson(jsonFile, scaleFactor, seed, tables, results);
+    writeCsv(csvFile, results);
+
+    // Remove the generated tables and the intermediate files
+    std::vector<std::string> files = {prefix + "join.tbl", prefix + "sorted.tbl", prefix + "sorted.tbl.idx"};
+    if (!keepData) {
+        files.insert(files.end(), {prefix + "part.tbl", prefix + "partsupp.tbl", prefix + "lineitem.tbl"});
+    }
+    for (int i = 1; i <= 16; ++i) files.push_back("chunk_col" + std::to_string(i) + ".tbl");
+    for (const auto &file : files) std::remove(file.c_str());
+
+    std::cout << "Results written to " << jsonFile << " and " << csvFile << "." << std::endl;
+    return 0;
+}
@@ -0,0 +1,416 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+// Checkpoints of the external sort (second part), so that an interrupted sort resumes from its last completed step.
+// The manifest, sort.manifest in the temp directory, lists the completed steps in order:
+//   #sort|<program>|<input>|<input size>|<input mtime>|<columns>|<B>|<M>|<fan-in>|<auto>
+//                                                                         the sort (B, M, fan-in 0 if left to --auto)
+//   sizes|<B>|<M>|<fan-in>                                                the sizes the sort runs with
+//   chunks|<rows>|<size of chunk_col1>|...|<size of chunk_col16>          the column chunks are complete
+//   run|<file>|<end row>|<bytes>|<checksum>[|<size of chunk_col1>|...]    a run of the input rows before <end row>
+//   runs|<count>                                                          all the runs are complete
+//   merge|<pass>|<group>|<file>|<bytes>|<checksum>|<input>|<input>...     a merge of an intermediate pass
+// Every line is written after the files of its step are closed. On restart, the files are checked (size and FNV-1a
+// checksum) and the sort resumes after the last step that is still valid, with the sizes it was started with (--auto
+// does not measure the machine again); without a manifest, or with one of another sort, it starts from the
+// beginning. The manifest is removed when the sort ends.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <cstdio>
+#include <sys/stat.h>
+#include <dirent.h>
+#include "sort_options.h"
+
+struct CheckpointRun {
+    std::string file;
+    long long endRow = 0;
+    long long bytes = 0;
+    unsigned long long checksum = 0;
+    std::vector<long long> chunkSizes;
+};
+
+struct CheckpointMerge {
+    int pass = 0;
+    int group = 0;
+    std::string file;
+    long long bytes = 0;
+    unsigned long long checksum = 0;
+    std::vector<std::string> inputs;
+};
+
+struct SortCheckpoint {
+    bool enabled = false;
+    std::string manifestFile;
+    std::ofstream manifest;
+
+    // Sizes of the interrupted sort, resolved by --auto when it started
+    long long bufferSize = 0;
+    long long memorySize = 0;
+    int mergeFanIn = 0;
+
+    // Steps already completed, read from the manifest when the sort resumes
+    bool chunksDone = false;
+    long long chunkRows = 0;
+    std::vector<long long> chunkSizes;
+    std::vector<CheckpointRun> runs;
+    bool runsDone = false;
+    std::vector<CheckpointMerge> merges;
+};
+
+inline SortCheckpoint &sortCheckpoint() {
+    static SortCheckpoint instance;
+    return instance;
+}
+
+// Size of a file; -1 if it does not exist
+inline long long fileSize(const std::string &file) {
+    struct stat info;
+    return stat(file.c_str(), &info) == 0 ? static_cast<long long>(info.st_size) : -1;
+}
+
+const unsigned long long FNV_OFFSET_BASIS = 14695981039346656037ULL;
+
+// FNV-1a checksum of `size` more bytes, continuing from `hash`
+inline unsigned long long fnv1a(unsigned long long hash, const char *data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// FNV-1a checksum of a whole file; its size goes to `bytes` (-1 if it cannot be read). Only used to check the files
+// of the manifest on restart: the files being written are checksummed as they are written (LineChecksum).
+inline unsigned long long fileChecksum(const std::string &file, long long &bytes) {
+    std::ifstream in(file, std::ios::binary);
+    unsigned long long hash = FNV_OFFSET_BASIS;
+    bytes = -1;
+    if (!in.is_open()) return 0;
+    bytes = 0;
+    std::vector<char> buffer(1 << 20);
+    while (in.read(buffer.data(), buffer.size()) || in.gcount() > 0) {
+        hash = fnv1a(hash, buffer.data(), in.gcount());
+        bytes += in.gcount();
+    }
+    return hash;
+}
+
+// Size and checksum of the lines written to a run or merge file, kept while they are written so that the file is
+// not read again for its checkpoint. The checksum is only computed when checkpointing is on.
+struct LineChecksum {
+    bool enabled = sortCheckpoint().enabled;
+    long long bytes = 0;
+    unsigned long long value = FNV_OFFSET_BASIS;
+
+    // `line` was written, followed by '\n'
+    void addLine(const std::string &line) {
+        bytes += line.size() + 1;
+        if (enabled) {
+            value = fnv1a(value, line.data(), line.size());
+            value = fnv1a(value, "\n", 1);
+        }
+    }
+};
+
+inline bool fileMatches(const std::string &file, long long bytes, unsigned long long checksum) {
+    long long actualBytes;
+    unsigned long long actualChecksum = fileChecksum(file, actualBytes);
+    return actualBytes == bytes && actualChecksum == checksum;
+}
+
+// Header of the manifest: the program ("serial" or "omp", whose steps differ), the input file (size and modification
+// time) and the options given by the user that shape the runs. Sizes chosen by --auto are not part of it, as they
+// change with the free memory of every start.
+inline std::string sortFingerprint(const SortOptions &options, const std::string &program) {
+    struct stat info;
+    long long size = -1, mtime = -1;
+    if (stat(options.inputFile.c_str(), &info) == 0) {
+        size = info.st_size;
+        mtime = info.st_mtime;
+    }
+    std::string columns;
+    for (int column : options.sortColumns) columns += (columns.empty() ? "" : ",") + std::to_string(column);
+    return "#sort|" + program + "|" + options.inputFile + "|" + std::to_string(size) + "|" + std::to_string(mtime) + "|" + columns +
+           "|" + std::to_string(options.givenBufferSize) + "|" + std::to_string(options.givenMemorySize) + "|" +
+           std::to_string(options.givenMergeFanIn) + "|" + (options.autoSize ? "auto" : "");
+}
+
+inline std::string manifestSizesLine(long long bufferSize, long long memorySize, int mergeFanIn) {
+    return "sizes|" + std::to_string(bufferSize) + "|" + std::to_string(memorySize) + "|" + std::to_string(mergeFanIn);
+}
+
+inline std::vector<std::string> splitManifestLine(const std::string &line) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, '|')) fields.push_back(field);
+    return fields;
+}
+
+inline std::string manifestRunLine(const CheckpointRun &run) {
+    std::string line = "run|" + run.file + "|" + std::to_string(run.endRow) + "|" + std::to_string(run.bytes) + "|" +
+                       std::to_string(run.checksum);
+    for (long long size : run.chunkSizes) line += "|" + std::to_string(size);
+    return line;
+}
+
+inline std::string manifestChunksLine(long long rows, const std::vector<long long> &sizes) {
+    std::string line = "chunks|" + std::to_string(rows);
+    for (long long size : sizes) line += "|" + std::to_string(size);
+    return line;
+}
+
+inline std::string manifestMergeLine(const CheckpointMerge &merge) {
+    std::string line = "merge|" + std::to_string(merge.pass) + "|" + std::to_string(merge.group) + "|" + merge.file +
+                       "|" + std::to_string(merge.bytes) + "|" + std::to_string(merge.checksum);
+    for (const auto &input : merge.inputs) line += "|" + input;
+    return line;
+}
+
+// Read the steps of a previous run of the same sort and keep those that are still valid; false if none can be used
+inline bool loadSortCheckpoint(SortCheckpoint &checkpoint, const std::string &fingerprint,
+                               std::vector<std::string> &staleFiles, const std::string &tempDir) {
+    std::ifstream in(checkpoint.manifestFile);
+    std::string line;
+    if (!in.is_open() || !std::getline(in, line)) return false;
+
+    bool sameSort = line == fingerprint;
+    while (std::getline(in, line)) {
+        // A last line without its newline was cut by the crash
+        if (in.eof()) break;
+        std::vector<std::string> fields = splitManifestLine(line);
+        if (fields.empty()) continue;
+        try {
+            if (fields[0] == "sizes" && fields.size() == 4) {
+                checkpoint.bufferSize = std::stoll(fields[1]);
+                checkpoint.memorySize = std::stoll(fields[2]);
+                checkpoint.mergeFanIn = std::stoi(fields[3]);
+            } else if (fields[0] == "chunks" && fields.size() == 18) {
+                checkpoint.chunksDone = true;
+                checkpoint.chunkRows = std::stoll(fields[1]);
+                checkpoint.chunkSizes.clear();
+                for (size_t i = 2; i < fields.size(); ++i) checkpoint.chunkSizes.push_back(std::stoll(fields[i]));
+            } else if (fields[0] == "run" && (fields.size() == 5 || fields.size() == 21)) {
+                CheckpointRun run;
+                run.file = fields[1];
+                run.endRow = std::stoll(fields[2]);
+                run.bytes = std::stoll(fields[3]);
+                run.checksum = std::stoull(fields[4]);
+                for (size_t i = 5; i < fields.size(); ++i) run.chunkSizes.push_back(std::stoll(fields[i]));
+                checkpoint.runs.push_back(run);
+            } else if (fields[0] == "runs" && fields.size() == 2) {
+                checkpoint.runsDone = std::stoull(fields[1]) == checkpoint.runs.size();
+            } else if (fields[0] == "merge" && fields.size() >= 7) {
+                CheckpointMerge merge;
+                merge.pass = std::stoi(fields[1]);
+                merge.group = std::stoi(fields[2]);
+                merge.file = fields[3];
+                merge.bytes = std::stoll(fields[4]);
+                merge.checksum = std::stoull(fields[5]);
+                merge.inputs.assign(fields.begin() + 6, fields.end());
+                checkpoint.merges.push_back(merge);
+            }
+        } catch (const std::exception &) {
+            break;
+        }
+    }
+    in.close();
+
+    for (const auto &run : checkpoint.runs) staleFiles.push_back(run.file);
+    for (const auto &merge : checkpoint.merges) staleFiles.push_back(merge.file);
+    if (!sameSort || checkpoint.bufferSize <= 0 || checkpoint.memorySize <= 0 || checkpoint.mergeFanIn < 2) {
+        return false;
+    }
+
+    // Chunk files of the serial version: complete, with their recorded sizes
+    for (size_t i = 0; i < checkpoint.chunkSizes.size(); ++i) {
+        if (fileSize(tempPath(tempDir, "chunk_col" + std::to_string(i + 1) + ".tbl")) != checkpoint.chunkSizes[i]) {
+            return false;
+        }
+    }
+
+    // A merge output that a later valid merge already consumed (and removed) needs no check
+    std::set<std::string> consumed;
+    for (size_t i = checkpoint.merges.size(); i-- > 0;) {
+        const CheckpointMerge &merge = checkpoint.merges[i];
+        if (!consumed.count(merge.file) && !fileMatches(merge.file, merge.bytes, merge.checksum)) return false;
+        consumed.insert(merge.inputs.begin(), merge.inputs.end());
+    }
+
+    // Runs: all of them once the merge started, otherwise the longest valid prefix (with its chunk files)
+    std::vector<CheckpointRun> allRuns = checkpoint.runs;
+    for (size_t i = 0; i < checkpoint.runs.size(); ++i) {
+        const CheckpointRun &run = checkpoint.runs[i];
+        bool valid = consumed.count(run.file) || fileMatches(run.file, run.bytes, run.checksum);
+        for (size_t c = 0; valid && c < run.chunkSizes.size(); ++c) {
+            valid = fileSize(tempPath(tempDir, "chunk_col" + std::to_string(c + 1) + ".tbl")) >= run.chunkSizes[c];
+        }
+        if (!valid) {
+            if (checkpoint.runsDone) return false;
+            checkpoint.runs.resize(i);
+            break;
+        }
+    }
+
+    // Files of the runs that were dropped are not needed anymore
+    staleFiles.clear();
+    for (size_t i = checkpoint.runs.size(); i < allRuns.size(); ++i) staleFiles.push_back(allRuns[i].file);
+    return checkpoint.chunksDone || !checkpoint.runs.empty();
+}
+
+// Files of a previous sort that is not resumed: the runs and merge outputs of its manifest, and the run and merge
+// files (chunk_run*.tbl) left in the temp directory that it was still writing when it stopped, which the manifest
+// does not list
+inline std::vector<std::string> previousSortFiles(const std::string &manifestFile, const std::string &tempDir) {
+    std::set<std::string> files;
+    std::ifstream in(manifestFile);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::vector<std::string> fields = splitManifestLine(line);
+        if (fields.size() >= 5 && fields[0] == "run") files.insert(fields[1]);
+        if (fields.size() >= 7 && fields[0] == "merge") files.insert(fields[3]);
+    }
+
+    DIR *dir = opendir(tempDir.empty() ? "." : tempDir.c_str());
+    if (dir != nullptr) {
+        while (dirent *entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.compare(0, 9, "chunk_run") == 0 && name.size() > 13 &&
+                name.compare(name.size() - 4, 4, ".tbl") == 0) {
+                files.insert(tempPath(tempDir, name));
+            }
+        }
+        closedir(dir);
+    }
+    return std::vector<std::string>(files.begin(), files.end());
+}
+
+// Start checkpointing: resume from the manifest of an interrupted run of the same sort, unless --no-resume was given.
+// When it resumes, B, M and the fan-in of `options` are set back to those of the interrupted sort.
+inline void openSortCheckpoint(SortOptions &options, const std::string &program) {
+    SortCheckpoint &checkpoint = sortCheckpoint();
+    checkpoint.enabled = true;
+    checkpoint.manifestFile = tempPath(options.tempDir, "sort.manifest");
+    std::string fingerprint = sortFingerprint(options, program);
+
+    std::vector<std::string> staleFiles;
+    bool resumed = options.resume && loadSortCheckpoint(checkpoint, fingerprint, staleFiles, options.tempDir);
+    if (!resumed) {
+        // Start over (also with --no-resume): the runs and merges of the previous sort are removed
+        staleFiles = previousSortFiles(checkpoint.manifestFile, options.tempDir);
+        checkpoint.chunksDone = false;
+        checkpoint.chunkSizes.clear();
+        checkpoint.runs.clear();
+        checkpoint.runsDone = false;
+        checkpoint.merges.clear();
+        checkpoint.bufferSize = options.bufferSize;
+        checkpoint.memorySize = options.memorySize;
+        checkpoint.mergeFanIn = options.mergeFanIn;
+    } else {
+        options.bufferSize = checkpoint.bufferSize;
+        options.memorySize = checkpoint.memorySize;
+        options.mergeFanIn = checkpoint.mergeFanIn;
+    }
+    for (const auto &file : staleFiles) std::remove(file.c_str());
+
+    // Rewrite the manifest with the steps that are kept, then append the next ones
+    std::string tmpFile = checkpoint.manifestFile + ".tmp";
+    std::ofstream out(tmpFile);
+    out << fingerprint << "\n";
+    out << manifestSizesLine(checkpoint.bufferSize, checkpoint.memorySize, checkpoint.mergeFanIn) << "\n";
+    if (checkpoint.chunksDone) out << manifestChunksLine(checkpoint.chunkRows, checkpoint.chunkSizes) << "\n";
+    for (const auto &run : checkpoint.runs) out << manifestRunLine(run) << "\n";
+    if (checkpoint.runsDone) out << "runs|" << checkpoint.runs.size() << "\n";
+    for (const auto &merge : checkpoint.merges) out << manifestMergeLine(merge) << "\n";
+    out.close();
+    if (!out || std::rename(tmpFile.c_str(), checkpoint.manifestFile.c_str()) != 0) {
+        std::cerr << "Error writing checkpoint manifest: " << checkpoint.manifestFile << std::endl;
+        exit(1);
+    }
+    checkpoint.manifest.open(checkpoint.manifestFile, std::ios::app);
+
+    if (resumed) {
+        std::cout << "Resuming interrupted sort: " << (checkpoint.chunksDone ? "column chunks, " : "")
+                  << checkpoint.runs.size() << " runs" << (checkpoint.runsDone ? " (all)" : "") << ", "
+                  << checkpoint.merges.size() << " merges already done (memory " << options.memorySize / MB
+                  << " MB, buffer " << options.bufferSize / MB << " MB, fan-in " << options.mergeFanIn << ")."
+                  << std::endl;
+    }
+}
+
+inline void writeCheckpointLine(const std::string &line) {
+    SortCheckpoint &checkpoint = sortCheckpoint();
+    checkpoint.manifest << line << "\n";
+    checkpoint.manifest.flush();
+}
+
+// The 16 column chunks are complete
+inline void checkpointChunks(long long rows, const std::vector<long long> &sizes) {
+    SortCheckpoint &checkpoint = sortCheckpoint();
+    if (!checkpoint.enabled) return;
+    checkpoint.chunksDone = true;
+    checkpoint.chunkRows = rows;
+    checkpoint.chunkSizes = sizes;
+    writeCheckpointLine(manifestChunksLine(rows, sizes));
+}
+
+// A run file is complete (closed); it holds the input rows before endRow
+inline void checkpointRun(const std::string &file, long long endRow, const LineChecksum &checksum,
+                          const std::vector<long long> &chunkSizes = {}) {
+    SortCheckpoint &checkpoint = sortCheckpoint();
+    if (!checkpoint.enabled) return;
+    CheckpointRun run;
+    run.file = file;
+    run.endRow = endRow;
+    run.bytes = checksum.bytes;
+    run.checksum = checksum.value;
+    run.chunkSizes = chunkSizes;
+    checkpoint.runs.push_back(run);
+    writeCheckpointLine(manifestRunLine(run));
+}
+
+inline void checkpointRunsDone() {
+    SortCheckpoint &checkpoint = sortCheckpoint();
+    if (!checkpoint.enabled) return;
+    checkpoint.runsDone = true;
+    writeCheckpointLine("runs|" + std::to_string(checkpoint.runs.size()));
+}
+
+// Output of an intermediate merge, if that merge was already done before the restart; empty otherwise
+inline std::string checkpointedMerge(int pass, int group) {
+    for (const auto &merge : sortCheckpoint().merges) {
+        if (merge.pass == pass && merge.group == group) return merge.file;
+    }
+    return "";
+}
+
+// An intermediate merge is complete; written before its input runs are removed
+inline void checkpointMerge(int pass, int group, const std::string &file, const LineChecksum &checksum,
+                            const std::vector<std::string> &inputs) {
+    SortCheckpoint &checkpoint = sortCheckpoint();
+    if (!checkpoint.enabled) return;
+    CheckpointMerge merge;
+    merge.pass = pass;
+    merge.group = group;
+    merge.file = file;
+    merge.bytes = checksum.bytes;
+    merge.checksum = checksum.value;
+    merge.inputs = inputs;
+    checkpoint.merges.push_back(merge);
+    writeCheckpointLine(manifestMergeLine(merge));
+}
+
+// The sort is complete: the manifest is not needed anymore
+inline void closeSortCheckpoint() {
+    SortCheckpoint &checkpoint = sortCheckpoint();
+    if (!checkpoint.enabled) return;
+    checkpoint.manifest.close();
+    std::remove(checkpoint.manifestFile.c_str());
+    checkpoint.enabled = false;
+}
+
+#endif
@@ -0,0 +1,452 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <queue>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include "zone_map.h"
+
+// Row of the table kept in memory while sorting, with its key already extracted
+struct SortRow {
+    std::string key;
+    double numericKey;
+    std::string line;
+};
+
+// Sorted segment of the LSM layout, as listed in the manifest
+struct Segment {
+    std::string file;
+    int level;
+    long long rows;
+};
+
+// Utility: Split a string by a delimiter
+std::vector<std::string> split(const std::string &str, char delimiter) {
+    std::vector<std::string> tokens;
+    size_t start = 0, end;
+    while ((end = str.find(delimiter, start)) != std::string::npos) {
+        tokens.push_back(str.substr(start, end - start));
+        start = end + 1;
+    }
+    tokens.push_back(str.substr(start));
+    return tokens;
+}
+
+// Compare two rows by the sorted column
+bool sortRowLess(const SortRow &a, const SortRow &b, int sortedColumnIndex) {
+    if (isNumericColumn(sortedColumnIndex)) {
+        return a.numericKey < b.numericKey;
+    }
+    return a.key < b.key;
+}
+
+// Build a SortRow from a full '|' separated line
+SortRow makeSortRow(const std::string &line, int sortedColumnIndex) {
+    SortRow row;
+    size_t start = 0;
+    for (int i = 0; i < sortedColumnIndex; ++i) {
+        start = line.find('|', start) + 1;
+    }
+    size_t end = line.find('|', start);
+    row.key = line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    row.numericKey = isNumericColumn(sortedColumnIndex) ? std::stod(row.key) : 0.0;
+    row.line = line;
+    return row;
+}
+
+// Sort the buffer and write it as a new run file
+void writeSortedRun(std::vector<SortRow> &buffer, int sortedColumnIndex, const std::string &runPrefix,
+                    std::vector<std::string> &runFiles) {
+    std::sort(buffer.begin(), buffer.end(), [sortedColumnIndex](const SortRow &a, const SortRow &b) {
+        return sortRowLess(a, b, sortedColumnIndex);
+    });
+
+    std::string runFile = runPrefix + "_run" + std::to_string(runFiles.size() + 1) + ".tbl";
+    std::ofstream outFile(runFile);
+    if (!outFile.is_open()) {
+        std::cerr << "Error opening run file: " << runFile << std::endl;
+        exit(1);
+    }
+    for (const auto &row : buffer) {
+        outFile << row.line << "\n";
+    }
+    outFile.close();
+    runFiles.push_back(runFile);
+    buffer.clear();
+}
+
+// Sort the rows of a lineitem delta (.tbl, one row per line) into runs, respecting memory size
+std::vector<std::string> sortDeltaIntoRuns(const std::string &deltaFile, int sortedColumnIndex,
+                                           long long memorySize, const std::string &runPrefix) {
+    std::ifstream inFile(deltaFile);
+    if (!inFile.is_open()) {
+        std::cerr << "Error opening delta file: " << deltaFile << std::endl;
+        exit(1);
+    }
+
+    std::vector<SortRow> buffer;
+    std::vector<std::string> runFiles;
+    long long bufferBytes = 0;
+    std::string line;
+
+    while (std::getline(inFile, line)) {
+        if (!line.empty() && line.back() == '|') line.pop_back();
+        if (line.empty()) continue;
+        buffer.push_back(makeSortRow(line, sortedColumnIndex));
+        bufferBytes += sizeof(SortRow) + line.size() + buffer.back().key.size();
+
+        if (bufferBytes >= memorySize) {
+            writeSortedRun(buffer, sortedColumnIndex, runPrefix, runFiles);
+            bufferBytes = 0;
+        }
+    }
+
+    if (!buffer.empty()) {
+        writeSortedRun(buffer, sortedColumnIndex, runPrefix, runFiles);
+    }
+    inFile.close();
+    return runFiles;
+}
+
+// Sorted file being read during the merge
+struct MergeSource {
+    std::ifstream stream;
+    SortRow row;
+};
+
+// Merge sorted files into outputFile and its sparse index in a single streaming pass.
+// Both are written to temporary files first, so an existing output is only replaced once complete.
+long long mergeSortedFiles(const std::vector<std::string> &inputFiles, int sortedColumnIndex,
+                           const std::string &outputFile) {
+    std::vector<MergeSource> sources(inputFiles.size());
+    auto greater = [&sources, sortedColumnIndex](size_t a, size_t b) {
+        // Equal keys come out in input order, so older rows stay first
+        if (sortRowLess(sources[b].row, sources[a].row, sortedColumnIndex)) return true;
+        if (sortRowLess(sources[a].row, sources[b].row, sortedColumnIndex)) return false;
+        return a > b;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+
+    std::string line;
+    for (size_t i = 0; i < inputFiles.size(); ++i) {
+        sources[i].stream.open(inputFiles[i]);
+        if (!sources[i].stream.is_open()) {
+            std::cerr << "Error opening sorted file: " << inputFiles[i] << std::endl;
+            exit(1);
+        }
+        if (std::getline(sources[i].stream, line)) {
+            sources[i].row = makeSortRow(line, sortedColumnIndex);
+            heap.push(i);
+        }
+    }
+
+    std::string tmpOutput = outputFile + ".tmp";
+    std::string tmpIndex = outputFile + ".idx.tmp";
+    std::ofstream outFile(tmpOutput);
+    std::ofstream indexFile(tmpIndex);
+    if (!outFile.is_open() || !indexFile.is_open()) {
+        std::cerr << "Error opening output file: " << outputFile << std::endl;
+        exit(1);
+    }
+    writeZoneMapHeader(indexFile, sortedColumnIndex);
+
+    ZoneMap zone;
+    long long offset = 0, rows = 0;
+
+    while (!heap.empty()) {
+        size_t i = heap.top();
+        heap.pop();
+
+        const std::string &row = sources[i].row.line;
+        outFile << row << "\n";
+        updateZoneMap(zone, row, sortedColumnIndex, offset);
+        offset += row.size() + 1;
+        rows++;
+        if (zone.rows == ZONE_MAP_BLOCK_ROWS) {
+            writeZoneMap(indexFile, zone);
+        }
+
+        if (std::getline(sources[i].stream, line)) {
+            sources[i].row = makeSortRow(line, sortedColumnIndex);
+            heap.push(i);
+        }
+    }
+    if (zone.rows > 0) {
+        writeZoneMap(indexFile, zone);
+    }
+
+    for (auto &source : sources) {
+        source.stream.close();
+    }
+    outFile.close();
+    indexFile.close();
+    if (!outFile || !indexFile) {
+        std::cerr << "Error writing output file: " << outputFile << std::endl;
+        exit(1);
+    }
+
+    // The old index is removed before the table is replaced, so it can never describe the new table:
+    // after a crash in between, the table is only left without its index
+    std::string index = outputFile + ".idx";
+    if (std::remove(index.c_str()) != 0 && errno != ENOENT) {
+        std::cerr << "Error removing old index file: " << index << std::endl;
+        exit(1);
+    }
+    if (std::rename(tmpOutput.c_str(), outputFile.c_str()) != 0 ||
+        std::rename(tmpIndex.c_str(), index.c_str()) != 0) {
+        std::cerr << "Error replacing output file: " << outputFile << std::endl;
+        exit(1);
+    }
+    return rows;
+}
+
+// Read the sorted column from an existing sparse index, or -1 if there is none
+int readIndexedColumn(const std::string &sortedFile) {
+    std::ifstream indexFile(sortedFile + ".idx");
+    std::string header;
+    if (!indexFile.is_open() || !std::getline(indexFile, header)) {
+        return -1;
+    }
+    int sortedColumnIndex;
+    size_t columns = 0;
+    if (!parseZoneMapHeader(header, sortedColumnIndex, columns)) {
+        return -1;
+    }
+    return sortedColumnIndex;
+}
+
+// Load the LSM manifest: "#segments|<column>" followed by one "file|level|rows" line per segment, oldest first
+std::vector<Segment> loadManifest(const std::string &manifestFile, int &sortedColumnIndex) {
+    std::vector<Segment> segments;
+    std::ifstream file(manifestFile);
+    if (!file.is_open()) {
+        return segments;
+    }
+
+    std::string line;
+    std::getline(file, line);
+    std::vector<std::string> header = split(line, '|');
+    if (header.size() != 2 || header[0] != "#segments") {
+        std::cerr << "Malformed manifest header: " << line << std::endl;
+        exit(1);
+    }
+    sortedColumnIndex = std::stoi(header[1]);
+
+    while (std::getline(file, line)) {
+        std::vector<std::string> fields = split(line, '|');
+        if (fields.size() != 3) {
+            std::cerr << "Malformed manifest row: " << line << std::endl;
+            continue;
+        }
+        segments.push_back({fields[0], std::stoi(fields[1]), std::stoll(fields[2])});
+    }
+    file.close();
+    return segments;
+}
+
+// Rewrite the manifest atomically, so a crash leaves either the old or the new list of segments
+void saveManifest(const std::string &manifestFile, int sortedColumnIndex, const std::vector<Segment> &segments) {
+    std::string tmpManifest = manifestFile + ".tmp";
+    std::ofstream file(tmpManifest);
+    if (!file.is_open()) {
+        std::cerr << "Error opening manifest file: " << manifestFile << std::endl;
+        exit(1);
+    }
+    file << "#segments|" << sortedColumnIndex << "\n";
+    for (const auto &segment : segments) {
+        file << segment.file << "|" << segment.level << "|" << segment.rows << "\n";
+    }
+    file.close();
+    if (!file || std::rename(tmpManifest.c_str(), manifestFile.c_str()) != 0) {
+        std::cerr << "Error writing manifest file: " << manifestFile << std::endl;
+        exit(1);
+    }
+}
+
+// Exclusive lock on <manifest>.lock, held from the load of the manifest to its save. An ingest and a compaction
+// (for example from a cron job) then run one after the other, instead of overwriting each other's manifest or
+// picking the same segment file name.
+struct ManifestLock {
+    int fd;
+
+    explicit ManifestLock(const std::string &manifestFile) {
+        std::string lockFile = manifestFile + ".lock";
+        fd = open(lockFile.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0 || flock(fd, LOCK_EX) != 0) {
+            std::cerr << "Error locking manifest file: " << lockFile << std::endl;
+            exit(1);
+        }
+    }
+
+    ~ManifestLock() {
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+};
+
+// Pick a segment file name that is not used by the manifest yet; called with the ManifestLock held
+std::string nextSegmentFile(const std::string &manifestFile, const std::vector<Segment> &segments) {
+    std::string base = manifestFile.substr(0, manifestFile.rfind('.'));
+    int id = 1;
+    for (const auto &segment : segments) {
+        size_t pos = segment.file.rfind("_seg");
+        if (pos != std::string::npos) {
+            id = std::max(id, std::stoi(segment.file.substr(pos + 4)) + 1);
+        }
+    }
+    return base + "_seg" + std::to_string(id) + ".tbl";
+}
+
+// Remove run or segment files (and their sparse index) once they are merged
+void removeFiles(const std::vector<std::string> &files) {
+    for (const auto &file : files) {
+        std::remove(file.c_str());
+        std::remove((file + ".idx").c_str());
+    }
+}
+
+// Merge a delta into an existing sorted table in one sequential pass
+void mergeDeltaIntoTable(const std::string &sortedFile, const std::string &deltaFile, int column, long long memorySize) {
+    int indexedColumn = readIndexedColumn(sortedFile);
+    if (indexedColumn >= 0 && indexedColumn != column) {
+        std::cerr << "The sorted table is sorted by column " << indexedColumn << ", not " << column << std::endl;
+        exit(1);
+    }
+
+    std::vector<std::string> runFiles = sortDeltaIntoRuns(deltaFile, column, memorySize, sortedFile + "_delta");
+    std::vector<std::string> inputs = {sortedFile};
+    inputs.insert(inputs.end(), runFiles.begin(), runFiles.end());
+
+    long long rows = mergeSortedFiles(inputs, column, sortedFile);
+    removeFiles(runFiles);
+    std::cout << "Sorted table " << sortedFile << " now has " << rows << " rows." << std::endl;
+}
+
+// Sort a delta into a new level 0 segment; no existing segment is read
+void ingestDeltaAsSegment(const std::string &manifestFile, const std::string &deltaFile, int column, long long memorySize) {
+    ManifestLock lock(manifestFile);
+    int manifestColumn = column;
+    std::vector<Segment> segments = loadManifest(manifestFile, manifestColumn);
+    if (manifestColumn != column) {
+        std::cerr << "The segments are sorted by column " << manifestColumn << ", not " << column << std::endl;
+        exit(1);
+    }
+
+    std::string segmentFile = nextSegmentFile(manifestFile, segments);
+    std::vector<std::string> runFiles = sortDeltaIntoRuns(deltaFile, column, memorySize, segmentFile);
+    long long rows = mergeSortedFiles(runFiles, column, segmentFile);
+    removeFiles(runFiles);
+
+    segments.push_back({segmentFile, 0, rows});
+    saveManifest(manifestFile, column, segments);
+    std::cout << "Segment " << segmentFile << " added with " << rows << " rows." << std::endl;
+}
+
+// Tiered compaction: while a level holds fanIn segments, merge its oldest fanIn segments into one on the next level
+void compactSegments(const std::string &manifestFile, int fanIn) {
+    ManifestLock lock(manifestFile);
+    int column = -1;
+    std::vector<Segment> segments = loadManifest(manifestFile, column);
+    if (column < 0) {
+        std::cerr << "Error opening manifest file: " << manifestFile << std::endl;
+        exit(1);
+    }
+
+    bool compacted = true;
+    while (compacted) {
+        compacted = false;
+        for (int level = 0; !compacted; ++level) {
+            std::vector<size_t> members;
+            bool levelExists = false;
+            for (size_t i = 0; i < segments.size(); ++i) {
+                if (segments[i].level == level) {
+                    levelExists = true;
+                    if (members.size() < static_cast<size_t>(fanIn)) members.push_back(i);
+                } else if (segments[i].level > level) {
+                    levelExists = true;
+                }
+            }
+            if (!levelExists) break;
+            if (members.size() < static_cast<size_t>(fanIn)) continue;
+
+            std::vector<std::string> inputs;
+            for (size_t i : members) inputs.push_back(segments[i].file);
+            std::string segmentFile = nextSegmentFile(manifestFile, segments);
+            long long rows = mergeSortedFiles(inputs, column, segmentFile);
+
+            // The merged segment takes the place of the oldest input, so the manifest stays ordered by age
+            std::vector<Segment> remaining;
+            for (size_t i = 0; i < segments.size(); ++i) {
+                if (i == members[0]) {
+                    remaining.push_back({segmentFile, level + 1, rows});
+                } else if (std::find(members.begin(), members.end(), i) == members.end()) {
+                    remaining.push_back(segments[i]);
+                }
+            }
+            segments = remaining;
+            saveManifest(manifestFile, column, segments);
+            removeFiles(inputs);
+
+            std::cout << "Compacted " << inputs.size() << " segments of level " << level
+                      << " into " << segmentFile << " (" << rows << " rows)." << std::endl;
+            compacted = true;
+        }
+    }
+}
+
+void printUsage(const char *program) {
+    std::cerr << "Usage:\n"
+              << "  " << program << " merge <sorted table> <delta.tbl> <column> <memory MB>\n"
+              << "  " << program << " ingest <manifest> <delta.tbl> <column> <memory MB>\n"
+              << "  " << program << " compact <manifest> [fan-in (default 4)]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    std::string mode = argv[1];
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    if ((mode == "merge" || mode == "ingest") && argc == 6) {
+        int column = std::stoi(argv[4]);
+        long long memoryMB = std::stoll(argv[5]);
+        if (column < 0 || column >= 16) {
+            std::cerr << "Invalid column index!" << std::endl;
+            return 1;
+        }
+        if (memoryMB <= 0) {
+            std::cerr << "Invalid memory size!" << std::endl;
+            return 1;
+        }
+        if (mode == "merge") {
+            mergeDeltaIntoTable(argv[2], argv[3], column, memoryMB * 1024 * 1024);
+        } else {
+            ingestDeltaAsSegment(argv[2], argv[3], column, memoryMB * 1024 * 1024);
+        }
+    } else if (mode == "compact" && (argc == 3 || argc == 4)) {
+        int fanIn = argc == 4 ? std::stoi(argv[3]) : 4;
+        if (fanIn < 2) {
+            std::cerr << "Invalid fan-in!" << std::endl;
+            return 1;
+        }
+        compactSegments(argv[2], fanIn);
+    } else {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    std::cout << "Elapsed time: " << elapsed.count() << " seconds." << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,256 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+// Runtime instrumentation of the join and sort programs: time, rows and bytes of every phase,
+// busy/idle time of the OpenMP threads, counters (runs, merge passes) and peak memory.
+//
+// Enabled by environment variables:
+//   METRICS=1              print a summary at the end of the program
+//   METRICS_JSON=<file>    write the metrics as JSON
+//   METRICS_TRACE=<file>   write a Chrome trace-event file (chrome://tracing or https://ui.perfetto.dev)
+// When none is set, every instrumented call only checks a flag.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <cstdlib>
+#include <cstdio>
+#include <sys/resource.h>
+
+// Interval in which a thread was working inside an OpenMP region
+struct ThreadSpan {
+    double start;
+    double end;
+};
+
+struct PhaseMetrics {
+    std::string name;
+    double start = 0;
+    double wallSeconds = 0;
+    double cpuSeconds = 0;
+    long long rowsRead = 0;
+    long long bytesRead = 0;
+    long long rowsWritten = 0;
+    long long bytesWritten = 0;
+    double parallelSeconds = 0;
+    std::vector<double> threadBusy;
+    std::vector<std::vector<ThreadSpan>> threadSpans;
+};
+
+struct Metrics {
+    bool enabled = false;
+    bool summary = false;
+    std::string jsonFile;
+    std::string traceFile;
+    std::chrono::steady_clock::time_point programStart = std::chrono::steady_clock::now();
+    std::vector<PhaseMetrics> phases;
+    std::vector<std::pair<std::string, long long>> counters;
+};
+
+inline Metrics &metrics() {
+    static Metrics instance;
+    return instance;
+}
+
+// Seconds since the program started
+inline double metricsNow() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - metrics().programStart).count();
+}
+
+// Read the METRICS* environment variables
+inline void metricsInit() {
+    Metrics &m = metrics();
+    const char *summary = std::getenv("METRICS");
+    const char *json = std::getenv("METRICS_JSON");
+    const char *trace = std::getenv("METRICS_TRACE");
+    m.summary = summary != nullptr && std::string(summary) != "" && std::string(summary) != "0";
+    m.jsonFile = json ? json : "";
+    m.traceFile = trace ? trace : "";
+    m.enabled = m.summary || !m.jsonFile.empty() || !m.traceFile.empty();
+    m.programStart = std::chrono::steady_clock::now();
+}
+
+// Add to a named counter (number of runs, merge passes, ...)
+inline void metricsCount(const std::string &name, long long value) {
+    Metrics &m = metrics();
+    if (!m.enabled) return;
+    for (auto &counter : m.counters) {
+        if (counter.first == name) {
+            counter.second += value;
+            return;
+        }
+    }
+    m.counters.push_back({name, value});
+}
+
+// Peak resident set size of the process, in KB
+inline long long metricsPeakRssKB() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Measures one phase from its construction to its destruction
+class MetricsPhase {
+public:
+    explicit MetricsPhase(const char *name) : active(metrics().enabled) {
+        if (!active) return;
+        phase.name = name;
+        phase.start = metricsNow();
+        cpuStart = std::clock();
+    }
+
+    ~MetricsPhase() {
+        if (!active) return;
+        phase.wallSeconds = metricsNow() - phase.start;
+        phase.cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+        metrics().phases.push_back(phase);
+    }
+
+    void read(long long rows, long long bytes) {
+        if (!active) return;
+        phase.rowsRead += rows;
+        phase.bytesRead += bytes;
+    }
+
+    void write(long long rows, long long bytes) {
+        if (!active) return;
+        phase.rowsWritten += rows;
+        phase.bytesWritten += bytes;
+    }
+
+    // Call before and after an OpenMP parallel region of `threads` threads
+    void beginParallel(int threads) {
+        if (!active) return;
+        if (phase.threadBusy.size() < static_cast<size_t>(threads)) {
+            phase.threadBusy.resize(threads);
+            phase.threadSpans.resize(threads);
+        }
+        parallelStart = metricsNow();
+    }
+
+    void endParallel() {
+        if (!active) return;
+        phase.parallelSeconds += metricsNow() - parallelStart;
+    }
+
+    // Inside the region: every thread reports the time it started working, when it is done
+    double now() const {
+        return active ? metricsNow() : 0;
+    }
+
+    void threadDone(int thread, double start) {
+        if (!active) return;
+        double end = metricsNow();
+        phase.threadBusy[thread] += end - start;
+        if (!metrics().traceFile.empty()) {
+            phase.threadSpans[thread].push_back({start, end});
+        }
+    }
+
+private:
+    bool active;
+    PhaseMetrics phase;
+    std::clock_t cpuStart = 0;
+    double parallelStart = 0;
+};
+
+inline void writeMetricsJson(const Metrics &m, const std::vector<PhaseMetrics> &phases, long long peakRssKB) {
+    std::ofstream out(m.jsonFile);
+    if (!out.is_open()) {
+        std::cerr << "Error opening metrics file: " << m.jsonFile << std::endl;
+        return;
+    }
+    out << "{\n  \"phases\": [\n";
+    for (size_t i = 0; i < phases.size(); ++i) {
+        const PhaseMetrics &p = phases[i];
+        out << "    {\"name\": \"" << p.name << "\", \"start\": " << p.start << ", \"wall_seconds\": " << p.wallSeconds
+            << ", \"cpu_seconds\": " << p.cpuSeconds << ", \"rows_read\": " << p.rowsRead
+            << ", \"bytes_read\": " << p.bytesRead << ", \"rows_written\": " << p.rowsWritten
+            << ", \"bytes_written\": " << p.bytesWritten << ", \"parallel_seconds\": " << p.parallelSeconds
+            << ", \"thread_busy_seconds\": [";
+        for (size_t t = 0; t < p.threadBusy.size(); ++t) {
+            out << (t ? ", " : "") << p.threadBusy[t];
+        }
+        out << "]}" << (i + 1 < phases.size() ? "," : "") << "\n";
+    }
+    out << "  ],\n  \"counters\": {";
+    for (size_t i = 0; i < m.counters.size(); ++i) {
+        out << (i ? ", " : "") << "\"" << m.counters[i].first << "\": " << m.counters[i].second;
+    }
+    out << "},\n  \"peak_rss_kb\": " << peakRssKB << "\n}\n";
+    out.close();
+}
+
+// Phases on thread 0, the work of each OpenMP thread on its own row; times in microseconds
+inline void writeMetricsTrace(const Metrics &m, const std::vector<PhaseMetrics> &phases) {
+    std::ofstream out(m.traceFile);
+    if (!out.is_open()) {
+        std::cerr << "Error opening trace file: " << m.traceFile << std::endl;
+        return;
+    }
+    out << "{\"traceEvents\": [\n";
+    bool first = true;
+    auto event = [&](const std::string &name, int tid, double start, double duration, const std::string &args) {
+        out << (first ? "" : ",\n") << "  {\"name\": \"" << name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+            << ", \"ts\": " << static_cast<long long>(start * 1e6)
+            << ", \"dur\": " << static_cast<long long>(duration * 1e6) << ", \"args\": {" << args << "}}";
+        first = false;
+    };
+    for (const auto &p : phases) {
+        event(p.name, 0, p.start, p.wallSeconds,
+              "\"rows_read\": " + std::to_string(p.rowsRead) + ", \"bytes_read\": " + std::to_string(p.bytesRead) +
+              ", \"rows_written\": " + std::to_string(p.rowsWritten) +
+              ", \"bytes_written\": " + std::to_string(p.bytesWritten));
+        for (size_t t = 0; t < p.threadSpans.size(); ++t) {
+            for (const auto &span : p.threadSpans[t]) {
+                event(p.name, static_cast<int>(t) + 1, span.start, span.end - span.start, "");
+            }
+        }
+    }
+    out << "\n]}\n";
+    out.close();
+}
+
+// Print the summary and write the reports that were asked for
+inline void metricsReport() {
+    Metrics &m = metrics();
+    if (!m.enabled) return;
+
+    std::vector<PhaseMetrics> phases = m.phases;
+    std::stable_sort(phases.begin(), phases.end(), [](const PhaseMetrics &a, const PhaseMetrics &b) {
+        return a.start < b.start;
+    });
+    long long peakRssKB = metricsPeakRssKB();
+
+    if (m.summary) {
+        char row[256];
+        std::printf("%-16s %10s %10s %12s %14s %12s %14s\n", "Phase", "Wall [s]", "CPU [s]",
+                    "Rows in", "Bytes in", "Rows out", "Bytes out");
+        for (const auto &p : phases) {
+            std::snprintf(row, sizeof(row), "%-16s %10.3f %10.3f %12lld %14lld %12lld %14lld", p.name.c_str(),
+                          p.wallSeconds, p.cpuSeconds, p.rowsRead, p.bytesRead, p.rowsWritten, p.bytesWritten);
+            std::printf("%s\n", row);
+            if (p.parallelSeconds > 0) {
+                std::printf("  OpenMP regions %.3f s, busy per thread:", p.parallelSeconds);
+                for (size_t t = 0; t < p.threadBusy.size(); ++t) {
+                    std::printf(" %zu: %.0f%%", t, 100.0 * p.threadBusy[t] / p.parallelSeconds);
+                }
+                std::printf("\n");
+            }
+        }
+        for (const auto &counter : m.counters) {
+            std::printf("%s: %lld\n", counter.first.c_str(), counter.second);
+        }
+        std::printf("Peak RSS: %lld KB\n", peakRssKB);
+        std::fflush(stdout);
+    }
+    if (!m.jsonFile.empty()) writeMetricsJson(m, phases, peakRssKB);
+    if (!m.traceFile.empty()) writeMetricsTrace(m, phases);
+}
+
+#endif
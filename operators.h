@@ -0,0 +1,679 @@
+#ifndef OPERATORS_H
+#define OPERATORS_H
+
+// Operators that exchange columnar batches of rows inside one process:
+//   TableScan, Filter, HashJoin, ExternalSort, Aggregate, and writeTable at the end of the pipeline.
+// Every operator pulls batches from its input with next(), so a pipeline is built by passing each operator
+// to the next one, e.g. ExternalSort(HashJoin(TableScan(part), TableScan(partsupp))), and runs without any
+// intermediate file. Only ExternalSort writes to disk, when its input does not fit in its memory budget.
+// The build side of HashJoin and the groups of Aggregate are kept in memory.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <functional>
+#include <queue>
+#include <memory>
+#include <limits>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include "metrics.h"
+#include "sort_options.h"
+
+enum class ColumnType { Int, Double, Text };
+
+struct Field {
+    std::string name;
+    ColumnType type;
+};
+
+typedef std::vector<Field> Schema;
+
+// Values of one column of a batch; only the vector of its type is used, except that a Double column read
+// from a table also keeps the original text of its values in `texts`, so that it is written back unchanged
+struct Column {
+    ColumnType type = ColumnType::Text;
+    std::vector<long long> ints;
+    std::vector<double> doubles;
+    std::vector<std::string> texts;
+};
+
+// Rows per batch produced by the operators
+const size_t BATCH_ROWS = 4096;
+
+// Rows of a batch, stored by column
+struct Batch {
+    std::vector<Column> columns;
+    size_t rows = 0;
+
+    // Empty the batch and set its columns to the types of the schema
+    void reset(const Schema &schema) {
+        columns.resize(schema.size());
+        for (size_t c = 0; c < schema.size(); ++c) {
+            columns[c].type = schema[c].type;
+            columns[c].ints.clear();
+            columns[c].doubles.clear();
+            columns[c].texts.clear();
+        }
+        rows = 0;
+    }
+
+    // Memory used by the values of the batch
+    long long memoryBytes() const {
+        long long bytes = 0;
+        for (const auto &column : columns) {
+            bytes += column.ints.size() * sizeof(long long) + column.doubles.size() * sizeof(double);
+            for (const auto &text : column.texts) bytes += sizeof(std::string) + text.size();
+        }
+        return bytes;
+    }
+};
+
+// Position of a column in a schema; exits if there is none with that name
+inline size_t fieldIndex(const Schema &schema, const std::string &name) {
+    for (size_t i = 0; i < schema.size(); ++i) {
+        if (schema[i].name == name) return i;
+    }
+    std::cerr << "Unknown column: " << name << std::endl;
+    exit(1);
+}
+
+inline void appendValue(Column &to, const Column &from, size_t row) {
+    switch (from.type) {
+        case ColumnType::Int: to.ints.push_back(from.ints[row]); break;
+        case ColumnType::Double:
+            to.doubles.push_back(from.doubles[row]);
+            if (!from.texts.empty()) to.texts.push_back(from.texts[row]);
+            break;
+        case ColumnType::Text: to.texts.push_back(from.texts[row]); break;
+    }
+}
+
+// Append row `row` of `from` to `to`, starting at column `firstColumn` of `to`, skipping column `skipColumn` of `from`
+inline void appendRow(Batch &to, const Batch &from, size_t row, size_t firstColumn = 0,
+                      size_t skipColumn = std::numeric_limits<size_t>::max()) {
+    size_t c = firstColumn;
+    for (size_t i = 0; i < from.columns.size(); ++i) {
+        if (i == skipColumn) continue;
+        appendValue(to.columns[c++], from.columns[i], row);
+    }
+}
+
+inline void parseValue(Column &column, const std::string &text) {
+    switch (column.type) {
+        case ColumnType::Int: column.ints.push_back(std::stoll(text)); break;
+        case ColumnType::Double:
+            column.doubles.push_back(std::stod(text));
+            column.texts.push_back(text);
+            break;
+        case ColumnType::Text: column.texts.push_back(text); break;
+    }
+}
+
+inline void writeValue(std::ostream &out, const Column &column, size_t row) {
+    switch (column.type) {
+        case ColumnType::Int: out << column.ints[row]; break;
+        case ColumnType::Double:
+            if (column.texts.empty()) out << column.doubles[row];
+            else out << column.texts[row];
+            break;
+        case ColumnType::Text: out << column.texts[row]; break;
+    }
+}
+
+// Numeric value of a row of an Int or Double column
+inline double numericValue(const Column &column, size_t row) {
+    return column.type == ColumnType::Int ? static_cast<double>(column.ints[row]) : column.doubles[row];
+}
+
+// -1, 0 or 1 as value a[i] is smaller, equal or greater than b[j]
+inline int compareValues(const Column &a, size_t i, const Column &b, size_t j) {
+    switch (a.type) {
+        case ColumnType::Int: return a.ints[i] < b.ints[j] ? -1 : (b.ints[j] < a.ints[i] ? 1 : 0);
+        case ColumnType::Double: return a.doubles[i] < b.doubles[j] ? -1 : (b.doubles[j] < a.doubles[i] ? 1 : 0);
+        case ColumnType::Text: return a.texts[i].compare(b.texts[j]) < 0 ? -1 : (a.texts[i] == b.texts[j] ? 0 : 1);
+    }
+    return 0;
+}
+
+// Compare two rows by the given columns, in order
+inline bool rowLess(const Batch &a, size_t i, const Batch &b, size_t j, const std::vector<size_t> &keys) {
+    for (size_t key : keys) {
+        int order = compareValues(a.columns[key], i, b.columns[key], j);
+        if (order != 0) return order < 0;
+    }
+    return false;
+}
+
+// Parse a '|' separated line (with or without the trailing '|') into a row of the batch; false if malformed
+inline bool parseRow(const std::string &line, Batch &batch) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (start < line.size()) {
+        size_t end = line.find('|', start);
+        if (end == std::string::npos) end = line.size();
+        fields.push_back(line.substr(start, end - start));
+        start = end + 1;
+    }
+    if (!line.empty() && line.back() == '|' && fields.size() + 1 == batch.columns.size()) {
+        fields.push_back("");
+    }
+    if (fields.size() != batch.columns.size()) return false;
+    for (size_t c = 0; c < fields.size(); ++c) {
+        parseValue(batch.columns[c], fields[c]);
+    }
+    batch.rows++;
+    return true;
+}
+
+inline void writeRow(std::ostream &out, const Batch &batch, size_t row) {
+    for (size_t c = 0; c < batch.columns.size(); ++c) {
+        if (c) out << "|";
+        writeValue(out, batch.columns[c], row);
+    }
+    out << "\n";
+}
+
+// Source of batches. next() fills `batch` (reset to schema()) and returns false when there are no more rows.
+class Operator {
+public:
+    virtual ~Operator() {}
+    virtual const Schema &schema() const = 0;
+    virtual bool next(Batch &batch) = 0;
+};
+
+// Read a '|' separated table file
+class TableScan : public Operator {
+public:
+    TableScan(const std::string &file, const Schema &schema) : tableSchema(schema), path(file), inFile(file) {
+        if (!inFile.is_open()) {
+            std::cerr << "Error opening file: " << file << std::endl;
+            exit(1);
+        }
+    }
+
+    const Schema &schema() const override { return tableSchema; }
+
+    bool next(Batch &batch) override {
+        batch.reset(tableSchema);
+        std::string line;
+        while (batch.rows < BATCH_ROWS && std::getline(inFile, line)) {
+            if (!parseRow(line, batch)) {
+                std::cerr << "Malformed row in " << path << ": " << line << std::endl;
+            }
+        }
+        return batch.rows > 0;
+    }
+
+private:
+    Schema tableSchema;
+    std::string path;
+    std::ifstream inFile;
+};
+
+typedef std::function<bool(const Batch &, size_t)> RowPredicate;
+
+// Keep the rows for which the predicate is true
+class Filter : public Operator {
+public:
+    Filter(Operator &input, RowPredicate predicate) : input(input), predicate(predicate) {}
+
+    const Schema &schema() const override { return input.schema(); }
+
+    bool next(Batch &batch) override {
+        batch.reset(schema());
+        Batch in;
+        while (batch.rows == 0 && input.next(in)) {
+            for (size_t row = 0; row < in.rows; ++row) {
+                if (predicate(in, row)) {
+                    appendRow(batch, in, row);
+                    batch.rows++;
+                }
+            }
+        }
+        return batch.rows > 0;
+    }
+
+private:
+    Operator &input;
+    RowPredicate predicate;
+};
+
+// Inner equi-join on Int columns. The build input is read whole into a hash table, then the probe input
+// is streamed through it. Output: the build columns, then the probe columns without the probe key.
+class HashJoin : public Operator {
+public:
+    HashJoin(Operator &build, const std::string &buildKey, Operator &probe, const std::string &probeKey)
+        : build(build), probe(probe), buildKey(fieldIndex(build.schema(), buildKey)),
+          probeKey(fieldIndex(probe.schema(), probeKey)) {
+        if (build.schema()[this->buildKey].type != ColumnType::Int ||
+            probe.schema()[this->probeKey].type != ColumnType::Int) {
+            std::cerr << "Join keys must be integer columns." << std::endl;
+            exit(1);
+        }
+        joinSchema = build.schema();
+        for (size_t c = 0; c < probe.schema().size(); ++c) {
+            if (c != this->probeKey) joinSchema.push_back(probe.schema()[c]);
+        }
+    }
+
+    const Schema &schema() const override { return joinSchema; }
+
+    bool next(Batch &batch) override {
+        if (!built) buildTable();
+        batch.reset(joinSchema);
+        Batch in;
+        while (batch.rows == 0 && probe.next(in)) {
+            const Column &keys = in.columns[probeKey];
+            for (size_t row = 0; row < in.rows; ++row) {
+                auto range = table.equal_range(keys.ints[row]);
+                for (auto it = range.first; it != range.second; ++it) {
+                    appendRow(batch, buildRows, it->second);
+                    appendRow(batch, in, row, buildRows.columns.size(), probeKey);
+                    batch.rows++;
+                }
+            }
+        }
+        return batch.rows > 0;
+    }
+
+private:
+    void buildTable() {
+        MetricsPhase phase("hash build");
+        buildRows.reset(build.schema());
+        Batch in;
+        while (build.next(in)) {
+            for (size_t row = 0; row < in.rows; ++row) {
+                table.emplace(in.columns[buildKey].ints[row], buildRows.rows);
+                appendRow(buildRows, in, row);
+                buildRows.rows++;
+            }
+        }
+        phase.read(buildRows.rows, buildRows.memoryBytes());
+        built = true;
+    }
+
+    Operator &build;
+    Operator &probe;
+    size_t buildKey;
+    size_t probeKey;
+    Schema joinSchema;
+    Batch buildRows;
+    std::unordered_multimap<long long, size_t> table;
+    bool built = false;
+};
+
+// Sort by the given columns (stable: equal rows keep the order of the input). The input is kept in memory
+// while it fits in memoryBudget bytes and sorted there; otherwise it is spilled as sorted runs into tempDir,
+// merged `fanIn` at a time until few enough remain to be merged while the output is read.
+class ExternalSort : public Operator {
+public:
+    ExternalSort(Operator &input, const std::vector<std::string> &sortColumns, long long memoryBudget,
+                 const std::string &tempDir = ".", int fanIn = 0)
+        : input(input), memoryBudget(memoryBudget), tempDir(tempDir),
+          fanIn(fanIn > 1 ? fanIn : autoMergeFanIn(memoryBudget)), sortId(nextSortId()) {
+        for (const auto &name : sortColumns) keys.push_back(fieldIndex(input.schema(), name));
+    }
+
+    ~ExternalSort() override {
+        for (auto &source : sources) source->stream.close();
+        for (const auto &file : runFiles) std::remove(file.c_str());
+    }
+
+    const Schema &schema() const override { return input.schema(); }
+
+    bool next(Batch &batch) override {
+        if (!consumed) consumeInput();
+        batch.reset(schema());
+        if (runFiles.empty()) {
+            // Everything fit in memory
+            while (batch.rows < BATCH_ROWS && position < order.size()) {
+                appendRow(batch, rows, order[position++]);
+                batch.rows++;
+            }
+        } else {
+            while (batch.rows < BATCH_ROWS && !heap.empty()) {
+                size_t s = heap.top();
+                heap.pop();
+                appendRow(batch, sources[s]->row, 0);
+                batch.rows++;
+                if (readSourceRow(*sources[s])) heap.push(s);
+            }
+        }
+        return batch.rows > 0;
+    }
+
+private:
+    // Open run file with its current row
+    struct RunSource {
+        std::ifstream stream;
+        std::string line;
+        Batch row;
+        size_t run;
+    };
+
+    // Orders the heap by the current row of each source, then by run, so that equal rows keep their order
+    struct SourceGreater {
+        const ExternalSort *sort;
+        bool operator()(size_t a, size_t b) const {
+            const RunSource &x = *sort->sources[a];
+            const RunSource &y = *sort->sources[b];
+            if (rowLess(y.row, 0, x.row, 0, sort->keys)) return true;
+            if (rowLess(x.row, 0, y.row, 0, sort->keys)) return false;
+            return x.run > y.run;
+        }
+    };
+
+    static int nextSortId() {
+        static int id = 0;
+        return ++id;
+    }
+
+    void consumeInput() {
+        MetricsPhase phase("run sort");
+        rows.reset(schema());
+        Batch in;
+        long long rowsRead = 0;
+        long long rowsBytes = 0;
+        while (input.next(in)) {
+            rowsRead += in.rows;
+            for (size_t row = 0; row < in.rows; ++row) {
+                appendRow(rows, in, row);
+                rows.rows++;
+            }
+            rowsBytes += in.memoryBytes() + in.rows * sizeof(size_t);
+            if (rowsBytes >= memoryBudget) {
+                spillRun(phase);
+                rowsBytes = 0;
+            }
+        }
+        phase.read(rowsRead, 0);
+        consumed = true;
+
+        if (runFiles.empty()) {
+            sortRows();
+            return;
+        }
+        if (rows.rows > 0) spillRun(phase);
+        metricsCount("runs", runFiles.size());
+
+        // Merge groups of fanIn runs until the last merge can be done while reading the output
+        MetricsPhase mergePhase("merge");
+        while (static_cast<int>(runFiles.size()) > fanIn) {
+            std::vector<std::string> merged;
+            for (size_t first = 0; first < runFiles.size(); first += fanIn) {
+                size_t last = std::min(runFiles.size(), first + fanIn);
+                std::vector<std::string> group(runFiles.begin() + first, runFiles.begin() + last);
+                if (group.size() == 1) {
+                    merged.push_back(group[0]);
+                    continue;
+                }
+                std::string file = runFile(runCount++);
+                mergeRunsToFile(group, file, mergePhase);
+                merged.push_back(file);
+            }
+            runFiles = merged;
+            metricsCount("merge passes", 1);
+        }
+        openSources(runFiles);
+        metricsCount("merge passes", 1);
+    }
+
+    void sortRows() {
+        order.resize(rows.rows);
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            return rowLess(rows, a, rows, b, keys);
+        });
+        position = 0;
+    }
+
+    std::string runFile(int index) const {
+        return tempPath(tempDir, "sort" + std::to_string(sortId) + "_run" + std::to_string(index) + ".tbl");
+    }
+
+    // Sort the rows in memory and write them as a new run
+    void spillRun(MetricsPhase &phase) {
+        sortRows();
+        std::string file = runFile(runCount++);
+        std::ofstream outFile(file);
+        if (!outFile.is_open()) {
+            std::cerr << "Error opening run file: " << file << std::endl;
+            exit(1);
+        }
+        // Computed Double columns have no original text: write them exactly, and drop the text when reading them back
+        outFile << std::setprecision(std::numeric_limits<double>::max_digits10);
+        computedColumns.resize(rows.columns.size());
+        for (size_t c = 0; c < rows.columns.size(); ++c) {
+            computedColumns[c] = rows.columns[c].type == ColumnType::Double && rows.columns[c].texts.empty();
+        }
+        for (size_t i : order) writeRow(outFile, rows, i);
+        phase.write(rows.rows, outFile.tellp());
+        outFile.close();
+        runFiles.push_back(file);
+        rows.reset(schema());
+        order.clear();
+    }
+
+    bool readSourceRow(RunSource &source) {
+        source.row.reset(schema());
+        while (std::getline(source.stream, source.line)) {
+            if (parseRow(source.line, source.row)) {
+                for (size_t c = 0; c < computedColumns.size(); ++c) {
+                    if (computedColumns[c]) source.row.columns[c].texts.clear();
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void openSources(const std::vector<std::string> &files) {
+        for (auto &source : sources) source->stream.close();
+        sources.clear();
+        heap = std::priority_queue<size_t, std::vector<size_t>, SourceGreater>(SourceGreater{this});
+        for (size_t i = 0; i < files.size(); ++i) {
+            sources.emplace_back(new RunSource());
+            sources.back()->stream.open(files[i]);
+            sources.back()->run = i;
+            if (!sources.back()->stream.is_open()) {
+                std::cerr << "Error opening run file: " << files[i] << std::endl;
+                exit(1);
+            }
+            if (readSourceRow(*sources.back())) heap.push(i);
+        }
+    }
+
+    // Merge runs into a new run file, and remove them
+    void mergeRunsToFile(const std::vector<std::string> &group, const std::string &file, MetricsPhase &phase) {
+        openSources(group);
+        std::ofstream outFile(file);
+        if (!outFile.is_open()) {
+            std::cerr << "Error opening run file: " << file << std::endl;
+            exit(1);
+        }
+        long long rowsWritten = 0;
+        while (!heap.empty()) {
+            size_t s = heap.top();
+            heap.pop();
+            outFile << sources[s]->line << "\n";
+            rowsWritten++;
+            if (readSourceRow(*sources[s])) heap.push(s);
+        }
+        phase.write(rowsWritten, outFile.tellp());
+        outFile.close();
+        for (auto &source : sources) source->stream.close();
+        sources.clear();
+        for (const auto &run : group) std::remove(run.c_str());
+    }
+
+    Operator &input;
+    std::vector<size_t> keys;
+    long long memoryBudget;
+    std::string tempDir;
+    int fanIn;
+    int sortId;
+    bool consumed = false;
+    Batch rows;
+    std::vector<size_t> order;
+    size_t position = 0;
+    int runCount = 0;
+    std::vector<std::string> runFiles;
+    std::vector<bool> computedColumns;
+    std::vector<std::unique_ptr<RunSource>> sources;
+    std::priority_queue<size_t, std::vector<size_t>, SourceGreater> heap{SourceGreater{this}};
+};
+
+enum class AggregateFunction { Sum, Count, Avg, Min, Max };
+
+typedef std::function<double(const Batch &, size_t)> RowValue;
+
+// Value of a numeric column, for an aggregate
+inline RowValue columnValue(const Schema &schema, const std::string &name) {
+    size_t column = fieldIndex(schema, name);
+    return [column](const Batch &batch, size_t row) { return numericValue(batch.columns[column], row); };
+}
+
+// One output column of Aggregate: function of a value computed from every row (ignored by Count)
+struct AggregateSpec {
+    std::string name;
+    AggregateFunction function;
+    RowValue value;
+};
+
+// Hash group-by. Output: the group columns, then one column per aggregate (Int for Count, Double otherwise),
+// with one row per group, ordered by the group columns.
+class Aggregate : public Operator {
+public:
+    Aggregate(Operator &input, const std::vector<std::string> &groupColumns, const std::vector<AggregateSpec> &aggregates)
+        : input(input), aggregates(aggregates) {
+        for (const auto &name : groupColumns) {
+            groupKeys.push_back(fieldIndex(input.schema(), name));
+            groupSchema.push_back(input.schema()[groupKeys.back()]);
+        }
+        outputSchema = groupSchema;
+        for (const auto &aggregate : aggregates) {
+            outputSchema.push_back({aggregate.name, aggregate.function == AggregateFunction::Count ? ColumnType::Int
+                                                                                                  : ColumnType::Double});
+        }
+    }
+
+    const Schema &schema() const override { return outputSchema; }
+
+    bool next(Batch &batch) override {
+        if (!aggregated) aggregateInput();
+        batch.reset(outputSchema);
+        while (batch.rows < BATCH_ROWS && position < order.size()) {
+            size_t group = order[position++];
+            appendRow(batch, groups, group);
+            for (size_t a = 0; a < aggregates.size(); ++a) {
+                const Accumulator &acc = accumulators[group * aggregates.size() + a];
+                Column &column = batch.columns[groupKeys.size() + a];
+                switch (aggregates[a].function) {
+                    case AggregateFunction::Count: column.ints.push_back(acc.count); break;
+                    case AggregateFunction::Sum: column.doubles.push_back(acc.sum); break;
+                    case AggregateFunction::Avg: column.doubles.push_back(acc.count ? acc.sum / acc.count : 0); break;
+                    case AggregateFunction::Min: column.doubles.push_back(acc.min); break;
+                    case AggregateFunction::Max: column.doubles.push_back(acc.max); break;
+                }
+            }
+            batch.rows++;
+        }
+        return batch.rows > 0;
+    }
+
+private:
+    struct Accumulator {
+        long long count = 0;
+        double sum = 0;
+        double min = std::numeric_limits<double>::infinity();
+        double max = -std::numeric_limits<double>::infinity();
+    };
+
+    void aggregateInput() {
+        MetricsPhase phase("aggregate");
+        groups.reset(groupSchema);
+        std::unordered_map<std::string, size_t> groupIndex;
+        Batch in;
+        long long rowsRead = 0;
+        std::string key;
+        while (input.next(in)) {
+            rowsRead += in.rows;
+            for (size_t row = 0; row < in.rows; ++row) {
+                key.clear();
+                for (size_t k : groupKeys) {
+                    const Column &column = in.columns[k];
+                    if (column.type == ColumnType::Text) key += column.texts[row];
+                    else if (column.type == ColumnType::Int) key += std::to_string(column.ints[row]);
+                    else key += std::to_string(column.doubles[row]);
+                    key += '\x1f';
+                }
+                auto found = groupIndex.emplace(key, groups.rows);
+                if (found.second) {
+                    for (size_t k = 0; k < groupKeys.size(); ++k) appendValue(groups.columns[k], in.columns[groupKeys[k]], row);
+                    groups.rows++;
+                    accumulators.resize(groups.rows * aggregates.size());
+                }
+                Accumulator *acc = &accumulators[found.first->second * aggregates.size()];
+                for (size_t a = 0; a < aggregates.size(); ++a) {
+                    acc[a].count++;
+                    if (aggregates[a].function == AggregateFunction::Count) continue;
+                    double value = aggregates[a].value(in, row);
+                    acc[a].sum += value;
+                    acc[a].min = std::min(acc[a].min, value);
+                    acc[a].max = std::max(acc[a].max, value);
+                }
+            }
+        }
+        phase.read(rowsRead, 0);
+        phase.write(groups.rows, 0);
+
+        std::vector<size_t> keys(groupKeys.size());
+        for (size_t k = 0; k < keys.size(); ++k) keys[k] = k;
+        order.resize(groups.rows);
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::sort(order.begin(), order.end(), [this, &keys](size_t a, size_t b) {
+            return rowLess(groups, a, groups, b, keys);
+        });
+        aggregated = true;
+    }
+
+    Operator &input;
+    std::vector<AggregateSpec> aggregates;
+    std::vector<size_t> groupKeys;
+    Schema groupSchema;
+    Schema outputSchema;
+    bool aggregated = false;
+    Batch groups;
+    std::vector<Accumulator> accumulators;
+    std::vector<size_t> order;
+    size_t position = 0;
+};
+
+// End of a pipeline: write every row of the input as a '|' separated line. Double columns read from a table
+// keep their original text; computed ones (the aggregates) get two decimals as in the TPC-H tables.
+// Returns the number of rows written.
+inline long long writeTable(Operator &input, const std::string &file) {
+    MetricsPhase phase("write");
+    std::ofstream outFile(file);
+    if (!outFile.is_open()) {
+        std::cerr << "Error opening output file: " << file << std::endl;
+        exit(1);
+    }
+    outFile << std::fixed << std::setprecision(2);
+    Batch batch;
+    long long rowsWritten = 0;
+    while (input.next(batch)) {
+        for (size_t row = 0; row < batch.rows; ++row) writeRow(outFile, batch, row);
+        rowsWritten += batch.rows;
+    }
+    phase.write(rowsWritten, outFile.tellp());
+    outFile.close();
+    return rowsWritten;
+}
+
+#endif
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "metrics.h"
+#include "operators.h"
+
+// Pipelines built from the operators of operators.h, run in one process without intermediate files:
+//   join-sort  part ⋈ partsupp, sorted by ps_supplycost
+//   sort       lineitem sorted by one column (the second part, without the column chunks)
+//   q1         TPC-H Q1 (scan, filter on l_shipdate, group by l_returnflag and l_linestatus)
+
+Schema partSchema() {
+    return {{"p_partkey", ColumnType::Int}, {"p_name", ColumnType::Text}, {"p_mfgr", ColumnType::Text},
+            {"p_brand", ColumnType::Text}, {"p_type", ColumnType::Text}, {"p_size", ColumnType::Int},
+            {"p_container", ColumnType::Text}, {"p_retailprice", ColumnType::Double}, {"p_comment", ColumnType::Text}};
+}
+
+Schema partSuppSchema() {
+    return {{"ps_partkey", ColumnType::Int}, {"ps_suppkey", ColumnType::Int}, {"ps_availqty", ColumnType::Int},
+            {"ps_supplycost", ColumnType::Double}, {"ps_comment", ColumnType::Text}};
+}
+
+Schema lineItemSchema() {
+    return {{"l_orderkey", ColumnType::Int}, {"l_partkey", ColumnType::Int}, {"l_suppkey", ColumnType::Int},
+            {"l_linenumber", ColumnType::Int}, {"l_quantity", ColumnType::Double},
+            {"l_extendedprice", ColumnType::Double}, {"l_discount", ColumnType::Double}, {"l_tax", ColumnType::Double},
+            {"l_returnflag", ColumnType::Text}, {"l_linestatus", ColumnType::Text}, {"l_shipdate", ColumnType::Text},
+            {"l_commitdate", ColumnType::Text}, {"l_receiptdate", ColumnType::Text}, {"l_shipinstruct", ColumnType::Text},
+            {"l_shipmode", ColumnType::Text}, {"l_comment", ColumnType::Text}};
+}
+
+void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " join-sort <part.tbl> <partsupp.tbl> <output> <M MB>\n"
+              << "       " << program << " sort <lineitem.tbl> <column 0-15> <output> <M MB>\n"
+              << "       " << program << " q1 <lineitem.tbl> <max shipdate> <output>" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    std::string mode = argc > 1 ? argv[1] : "";
+    if (!((mode == "join-sort" || mode == "sort") && argc == 6) && !(mode == "q1" && argc == 5)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    metricsInit();
+    auto start = std::chrono::high_resolution_clock::now();
+    long long rows = 0;
+
+    if (mode == "join-sort") {
+        long long M = parseSize(argv[5]);
+        if (M <= 0) {
+            std::cerr << "Invalid memory size!" << std::endl;
+            return 1;
+        }
+        TableScan part(argv[2], partSchema());
+        TableScan partSupp(argv[3], partSuppSchema());
+        HashJoin join(part, "p_partkey", partSupp, "ps_partkey");
+        ExternalSort sort(join, {"ps_supplycost"}, M);
+        rows = writeTable(sort, argv[4]);
+    } else if (mode == "sort") {
+        int column = std::atoi(argv[3]);
+        long long M = parseSize(argv[5]);
+        if (column < 0 || column >= 16 || M <= 0) {
+            std::cerr << "Invalid column index or memory size!" << std::endl;
+            return 1;
+        }
+        TableScan lineItem(argv[2], lineItemSchema());
+        ExternalSort sort(lineItem, {lineItemSchema()[column].name}, M);
+        rows = writeTable(sort, argv[4]);
+    } else {
+        // SELECT l_returnflag, l_linestatus, sum(l_quantity), sum(l_extendedprice),
+        //        sum(l_extendedprice * (1 - l_discount)), sum(l_extendedprice * (1 - l_discount) * (1 + l_tax)),
+        //        avg(l_quantity), avg(l_extendedprice), avg(l_discount), count(*)
+        // FROM lineitem WHERE l_shipdate <= <max shipdate> GROUP BY l_returnflag, l_linestatus
+        std::string maxShipDate = argv[3];
+        Schema schema = lineItemSchema();
+        size_t shipDate = fieldIndex(schema, "l_shipdate");
+        size_t price = fieldIndex(schema, "l_extendedprice");
+        size_t discount = fieldIndex(schema, "l_discount");
+        size_t tax = fieldIndex(schema, "l_tax");
+        RowValue discPrice = [=](const Batch &batch, size_t row) {
+            return batch.columns[price].doubles[row] * (1 - batch.columns[discount].doubles[row]);
+        };
+        RowValue charge = [=](const Batch &batch, size_t row) {
+            return discPrice(batch, row) * (1 + batch.columns[tax].doubles[row]);
+        };
+
+        TableScan lineItem(argv[2], schema);
+        Filter shipped(lineItem, [=](const Batch &batch, size_t row) {
+            return batch.columns[shipDate].texts[row] <= maxShipDate;
+        });
+        Aggregate q1(shipped, {"l_returnflag", "l_linestatus"},
+                     {{"sum_qty", AggregateFunction::Sum, columnValue(schema, "l_quantity")},
+                      {"sum_base_price", AggregateFunction::Sum, columnValue(schema, "l_extendedprice")},
+                      {"sum_disc_price", AggregateFunction::Sum, discPrice},
+                      {"sum_charge", AggregateFunction::Sum, charge},
+                      {"avg_qty", AggregateFunction::Avg, columnValue(schema, "l_quantity")},
+                      {"avg_price", AggregateFunction::Avg, columnValue(schema, "l_extendedprice")},
+                      {"avg_disc", AggregateFunction::Avg, columnValue(schema, "l_discount")},
+                      {"count_order", AggregateFunction::Count, nullptr}});
+        rows = writeTable(q1, argv[4]);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    std::cout << rows << " rows written to " << argv[4] << ".\n";
+    std::cout << "Elapsed time: " << elapsed.count() << " seconds." << std::endl;
+    metricsReport();
+
+    return 0;
+}
@@ -5,6 +5,7 @@
 #include <vector>
 #include <unordered_map>
 #include <chrono>
+#include "metrics.h"
 
 // Structure to hold column data for 'part'
 struct Part {
@@ -41,6 +42,7 @@ std::vector<std::string> splitLine(const std::string &line, char delimiter) {
 
 // Load 'part' table data into a map
 std::unordered_map<int, Part> loadPartTable(const std::string &filePath) {
+    MetricsPhase phase("hash build");
     std::ifstream file(filePath);
     if (!file.is_open()) {
         std::cerr << "Error opening PART file." << std::endl;
@@ -49,7 +51,10 @@ std::unordered_map<int, Part> loadPartTable(const std::string &filePath) {
 
     std::unordered_map<int, Part> partMap;
     std::string line;
+    long long rowsRead = 0, bytesRead = 0;
     while (std::getline(file, line)) {
+        rowsRead++;
+        bytesRead += line.size() + 1;
         auto fields = splitLine(line, '|');
         if (fields.size() != 9) {
             std::cerr << "Malformed PART row: " << line << std::endl;
@@ -71,11 +76,13 @@ std::unordered_map<int, Part> loadPartTable(const std::string &filePath) {
         partMap[part.p_partkey] = part;
     }
     file.close();
+    phase.read(rowsRead, bytesRead);
     return partMap;
 }
 
 // Process 'partsupp' table and perform join
 void processPartSupp(const std::string &partSuppFile, const std::unordered_map<int, Part> &partMap, const std::string &outputFile) {
+    MetricsPhase phase("probe + output");
     std::ifstream file(partSuppFile);
     if (!file.is_open()) {
         std::cerr << "Error opening PARTSUPP file." << std::endl;
@@ -89,7 +96,10 @@ void processPartSupp(const std::string &partSuppFile, const std::unordered_map<i
     }
 
     std::string line;
+    long long rowsRead = 0, bytesRead = 0, rowsWritten = 0;
     while (std::getline(file, line)) {
+        rowsRead++;
+        bytesRead += line.size() + 1;
         auto fields = splitLine(line, '|');
         if (fields.size() != 5) {
             std::cerr << "Malformed PARTSUPP row: " << line << std::endl;
@@ -114,8 +124,11 @@ void processPartSupp(const std::string &partSuppFile, const std::unordered_map<i
                     << part.p_container << "|" << part.p_retailprice << "|" << part.p_comment << "|"
                     << partsupp.ps_suppkey << "|" << partsupp.ps_availqty << "|"
                     << partsupp.ps_supplycost << "|" << partsupp.ps_comment << "\n";
+            rowsWritten++;
         }
     }
+    phase.read(rowsRead, bytesRead);
+    phase.write(rowsWritten, outFile.tellp());
     file.close();
     outFile.close();
 }
@@ -125,6 +138,7 @@ int main() {
     std::string partSuppFilePath = "TPC-H/dbgen/partsupp.tbl";
     std::string outputFilePath = "join_results_final.tbl";
 
+    metricsInit();
     auto start_time = std::chrono::high_resolution_clock::now();
 
     // Load part table into a hash map
@@ -136,6 +150,7 @@ int main() {
     auto end_time = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> elapsed_time = end_time - start_time;
     std::cout << "Elapsed time: " << elapsed_time.count() << " seconds." << std::endl;
+    metricsReport();
 
     return 0;
 }
@@ -4,6 +4,14 @@
 #include <string>
 #include <algorithm>
 #include <chrono>
+#include <queue>
+#include <limits>
+#include <cstdio>
+#include <iomanip>
+#include "metrics.h"
+#include "sort_options.h"
+#include "checkpoint.h"
+#include "zone_map.h"
 
 struct LineItem {
     int l_orderkey;
@@ -60,27 +68,44 @@ LineItem parseLineItem(const std::string &line) {
 }
 
 // Separate columns into chunks, respecting buffer size
-void separateColumnsToChunksWithBuffer(const std::string &inputFile, int bufferSize) {
+void separateColumnsToChunksWithBuffer(const std::string &inputFile, long long bufferSize, const std::string &tempDir) {
+    // Already split before the sort was interrupted
+    if (sortCheckpoint().chunksDone) {
+        return;
+    }
+    MetricsPhase phase("split");
     std::ifstream inFile(inputFile);
+    if (!inFile.is_open()) {
+        std::cerr << "Error opening LINEITEM file: " << inputFile << std::endl;
+        exit(1);
+    }
     std::vector<std::ofstream> columnFiles(16);
     for (int i = 0; i < 16; ++i) {
-        columnFiles[i].open("chunk_col" + std::to_string(i + 1) + ".tbl");
+        columnFiles[i].open(tempPath(tempDir, "chunk_col" + std::to_string(i + 1) + ".tbl"));
         if (!columnFiles[i].is_open()) {
             std::cerr << "Error opening file for column " << i + 1 << std::endl;
             return;
         }
+        // Keep the two decimals of l_extendedprice, l_discount and l_tax
+        if (i >= 5 && i <= 7) {
+            columnFiles[i] << std::fixed << std::setprecision(2);
+        }
     }
 
     std::string line;
-    int rowCount = 0;
+    size_t rowCount = 0;
+    size_t rowsPerBuffer = std::max<size_t>(1, bufferSize / sizeof(LineItem));
+    long long rowsRead = 0, bytesRead = 0;
     std::vector<LineItem> buffer;
 
     while (std::getline(inFile, line)) {
+        rowsRead++;
+        bytesRead += line.size() + 1;
         if (!line.empty() && line.back() == '|') line.pop_back();
         buffer.push_back(parseLineItem(line));
         rowCount++;
 
-        if (rowCount == bufferSize / sizeof(LineItem)) {
+        if (rowCount == rowsPerBuffer) {
             for (const auto &item : buffer) {
                 columnFiles[0] << item.l_orderkey << "\n";
                 columnFiles[1] << item.l_partkey << "\n";
@@ -123,149 +148,321 @@ void separateColumnsToChunksWithBuffer(const std::string &inputFile, int bufferS
         columnFiles[15] << item.l_comment << "\n";
     }
 
+    long long bytesWritten = 0;
+    std::vector<long long> chunkSizes;
     for (auto &file : columnFiles) {
+        chunkSizes.push_back(file.tellp());
+        bytesWritten += chunkSizes.back();
         file.close();
     }
     inFile.close();
+    checkpointChunks(rowsRead, chunkSizes);
+    phase.read(rowsRead, bytesRead);
+    phase.write(rowsRead, bytesWritten);
 }
 
-// Sort a selected column chunk, respecting memory size
-void sortSelectedColumnChunkWithMemory(const std::string &inputFile, const std::string &outputFile, int memorySize) {
-    std::ifstream inFile(inputFile);
-    std::vector<std::string> buffer;
-    std::string value;
-    int rowCount = 0;
+// Row of the table kept in memory while sorting, with its key already extracted
+struct SortRow {
+    std::string key;
+    double numericKey;
+    std::string line;
+};
 
-    while (std::getline(inFile, value)) {
-        buffer.push_back(value);
-        rowCount++;
+// Value of a column in a full '|' separated line
+std::string fieldOf(const std::string &line, int column) {
+    size_t start = 0;
+    for (int i = 0; i < column; ++i) {
+        start = line.find('|', start) + 1;
+    }
+    size_t end = line.find('|', start);
+    return line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
 
-        if (rowCount == memorySize / sizeof(std::string)) {
-            std::sort(buffer.begin(), buffer.end());
-            std::ofstream outFile(outputFile, std::ios::app);
-            for (const auto &val : buffer) {
-                outFile << val << "\n";
-            }
-            outFile.close();
-            buffer.clear();
-            rowCount = 0;
-        }
+// Compare two rows by the sort columns; the first one is already extracted, the others only on ties
+bool sortRowLess(const SortRow &a, const SortRow &b, const std::vector<int> &sortColumns) {
+    if (isNumericColumn(sortColumns[0])) {
+        if (a.numericKey != b.numericKey) return a.numericKey < b.numericKey;
+    } else if (a.key != b.key) {
+        return a.key < b.key;
+    }
+    for (size_t i = 1; i < sortColumns.size(); ++i) {
+        std::string valueA = fieldOf(a.line, sortColumns[i]);
+        std::string valueB = fieldOf(b.line, sortColumns[i]);
+        if (columnValueLess(sortColumns[i], valueA, valueB)) return true;
+        if (columnValueLess(sortColumns[i], valueB, valueA)) return false;
     }
+    return false;
+}
+
+// Build a SortRow from a full '|' separated line
+SortRow makeSortRow(const std::string &line, int sortedColumnIndex) {
+    SortRow row;
+    row.key = fieldOf(line, sortedColumnIndex);
+    row.numericKey = isNumericColumn(sortedColumnIndex) ? std::stod(row.key) : 0.0;
+    row.line = line;
+    return row;
+}
 
-    std::sort(buffer.begin(), buffer.end());
-    std::ofstream outFile(outputFile, std::ios::app);
-    for (const auto &val : buffer) {
-        outFile << val << "\n";
+// Sort the buffer and write it as a new run file; returns its checksum, for its checkpoint
+LineChecksum writeSortedRun(std::vector<SortRow> &buffer, const std::vector<int> &sortColumns,
+                            const std::string &tempDir, std::vector<std::string> &runFiles, MetricsPhase &phase) {
+    std::sort(buffer.begin(), buffer.end(), [&sortColumns](const SortRow &a, const SortRow &b) {
+        return sortRowLess(a, b, sortColumns);
+    });
+
+    std::string runFile = tempPath(tempDir, "chunk_run" + std::to_string(runFiles.size() + 1) + ".tbl");
+    std::ofstream outFile(runFile);
+    if (!outFile.is_open()) {
+        std::cerr << "Error opening run file: " << runFile << std::endl;
+        exit(1);
     }
+    LineChecksum checksum;
+    for (const auto &row : buffer) {
+        outFile << row.line << "\n";
+        checksum.addLine(row.line);
+    }
+    phase.write(buffer.size(), outFile.tellp());
     outFile.close();
-    inFile.close();
+    runFiles.push_back(runFile);
+    buffer.clear();
+    return checksum;
 }
 
-// Merge columns based on sorted column
-void mergeColumnsWithSortedColumn(const std::string &sortedColumnFile,
-                                  const std::vector<std::string> &columnFiles,
-                                  int sortedColumnIndex,
-                                  const std::string &outputFile) {
-    // Open the sorted column file
-    std::ifstream sortedFile(sortedColumnFile);
-    if (!sortedFile.is_open()) {
-        std::cerr << "Error opening sorted column file: " << sortedColumnFile << std::endl;
-        return;
+// Rebuild the rows from the column chunks and sort them by the selected column into runs, respecting memory size
+std::vector<std::string> sortSelectedColumnChunkWithMemory(const std::vector<std::string> &columnFiles,
+                                                           const std::vector<int> &sortColumns,
+                                                           long long memorySize,
+                                                           const std::string &tempDir) {
+    // Runs made before the sort was interrupted
+    const SortCheckpoint &checkpoint = sortCheckpoint();
+    std::vector<std::string> runFiles;
+    for (const auto &run : checkpoint.runs) {
+        runFiles.push_back(run.file);
+    }
+    if (checkpoint.runsDone) {
+        return runFiles;
     }
 
-    // Open all column files
+    MetricsPhase phase("run sort");
     std::vector<std::ifstream> columnStreams(columnFiles.size());
     for (size_t i = 0; i < columnFiles.size(); ++i) {
         columnStreams[i].open(columnFiles[i]);
         if (!columnStreams[i].is_open()) {
             std::cerr << "Error opening column file: " << columnFiles[i] << std::endl;
-            return;
+            exit(1);
+        }
+    }
+
+    std::vector<SortRow> buffer;
+    std::vector<std::string> columnValues(columnFiles.size());
+    long long bufferBytes = 0;
+
+    // Skip the rows that are already in the runs
+    long long row = checkpoint.runs.empty() ? 0 : checkpoint.runs.back().endRow;
+    for (long long skipped = 0; skipped < row; ++skipped) {
+        for (auto &stream : columnStreams) {
+            stream.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+    }
+
+    while (std::getline(columnStreams[0], columnValues[0])) {
+        for (size_t i = 1; i < columnFiles.size(); ++i) {
+            std::getline(columnStreams[i], columnValues[i]);
+        }
+
+        std::string line = columnValues[0];
+        for (size_t i = 1; i < columnValues.size(); ++i) {
+            line += "|" + columnValues[i];
+        }
+        buffer.push_back(makeSortRow(line, sortColumns[0]));
+        bufferBytes += sizeof(SortRow) + line.size() + buffer.back().key.size();
+        phase.read(1, line.size() + 1);
+        row++;
+
+        if (bufferBytes >= memorySize) {
+            LineChecksum checksum = writeSortedRun(buffer, sortColumns, tempDir, runFiles, phase);
+            checkpointRun(runFiles.back(), row, checksum);
+            bufferBytes = 0;
+        }
+    }
+
+    if (!buffer.empty()) {
+        LineChecksum checksum = writeSortedRun(buffer, sortColumns, tempDir, runFiles, phase);
+        checkpointRun(runFiles.back(), row, checksum);
+    }
+    checkpointRunsDone();
+
+    for (auto &stream : columnStreams) {
+        stream.close();
+    }
+    metricsCount("runs", runFiles.size());
+    return runFiles;
+}
+
+// Run being read during the merge
+struct MergeSource {
+    std::ifstream stream;
+    SortRow row;
+};
+
+// Merge sorted runs into outputFile in one pass; the final pass also writes the sparse index (outputFile + ".idx").
+// Returns the checksum of an intermediate output, for its checkpoint.
+LineChecksum mergeRuns(const std::vector<std::string> &runFiles,
+               const std::vector<int> &sortColumns,
+               const std::string &outputFile,
+               bool writeIndex,
+               MetricsPhase &phase) {
+    std::vector<MergeSource> sources(runFiles.size());
+    auto greater = [&sources, &sortColumns](size_t a, size_t b) {
+        return sortRowLess(sources[b].row, sources[a].row, sortColumns);
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+
+    // Open every run and read its first row
+    std::string line;
+    for (size_t i = 0; i < runFiles.size(); ++i) {
+        sources[i].stream.open(runFiles[i]);
+        if (!sources[i].stream.is_open()) {
+            std::cerr << "Error opening run file: " << runFiles[i] << std::endl;
+            exit(1);
+        }
+        if (std::getline(sources[i].stream, line)) {
+            sources[i].row = makeSortRow(line, sortColumns[0]);
+            heap.push(i);
         }
     }
 
-    // Open the output file
     std::ofstream outFile(outputFile);
-    if (!outFile.is_open()) {
+    std::ofstream indexFile;
+    if (writeIndex) {
+        indexFile.open(outputFile + ".idx");
+    }
+    if (!outFile.is_open() || (writeIndex && !indexFile.is_open())) {
         std::cerr << "Error opening output file: " << outputFile << std::endl;
-        return;
+        exit(1);
+    }
+    if (writeIndex) {
+        writeZoneMapHeader(indexFile, sortColumns[0]);
     }
 
-    std::string sortedValue;
-    std::vector<std::string> columnValues(columnFiles.size());
+    ZoneMap zone;
+    LineChecksum checksum;
+    long long offset = 0, rows = 0;
+
+    // Always write the smallest row among the runs
+    while (!heap.empty()) {
+        size_t i = heap.top();
+        heap.pop();
 
-    // Process each line in the sorted column file
-    while (std::getline(sortedFile, sortedValue)) {
-        for (size_t i = 0; i < columnFiles.size(); ++i) {
-            if (i == static_cast<size_t>(sortedColumnIndex)) {
-                columnValues[i] = sortedValue; // Use the sorted column value
-            } else {
-                std::getline(columnStreams[i], columnValues[i]); // Use the original values for other columns
+        const std::string &row = sources[i].row.line;
+        outFile << row << "\n";
+        if (writeIndex) {
+            updateZoneMap(zone, row, sortColumns[0], offset);
+            if (zone.rows == ZONE_MAP_BLOCK_ROWS) {
+                writeZoneMap(indexFile, zone);
             }
+        } else {
+            checksum.addLine(row);
         }
+        offset += row.size() + 1;
+        rows++;
 
-        // Write the reconstructed row to the output file
-        for (size_t i = 0; i < columnValues.size(); ++i) {
-            outFile << columnValues[i];
-            if (i < columnValues.size() - 1) {
-                outFile << "|";
-            }
+        if (std::getline(sources[i].stream, line)) {
+            sources[i].row = makeSortRow(line, sortColumns[0]);
+            heap.push(i);
         }
-        outFile << "\n";
+    }
+    if (zone.rows > 0) {
+        writeZoneMap(indexFile, zone);
     }
 
-    // Close all files
-    sortedFile.close();
-    for (auto &stream : columnStreams) {
-        stream.close();
+    // Close all files; the caller removes the runs once the merge is checkpointed
+    for (size_t i = 0; i < sources.size(); ++i) {
+        sources[i].stream.close();
     }
+    phase.read(rows, offset);
+    phase.write(rows, offset + (writeIndex ? static_cast<long long>(indexFile.tellp()) : 0));
     outFile.close();
+    if (writeIndex) {
+        indexFile.close();
+    }
+    metricsCount("merges", 1);
+    return checksum;
 }
 
+// Merge the sorted runs into the final table, at most fanIn runs at a time.
+// While there are more runs than fanIn, groups of fanIn runs are merged into longer runs (one pass each).
+void mergeChunksWithSortedColumn(std::vector<std::string> runFiles,
+                                 const std::vector<int> &sortColumns,
+                                 const std::string &outputFile,
+                                 int fanIn,
+                                 const std::string &tempDir) {
+    MetricsPhase phase("merge");
+    int pass = 0;
+    while (runFiles.size() > static_cast<size_t>(fanIn)) {
+        pass++;
+        std::vector<std::string> mergedRuns;
+        for (size_t first = 0; first < runFiles.size(); first += fanIn) {
+            size_t last = std::min(runFiles.size(), first + fanIn);
+            std::vector<std::string> group(runFiles.begin() + first, runFiles.begin() + last);
+            if (group.size() == 1) {
+                mergedRuns.push_back(group[0]);
+                continue;
+            }
+            int groupIndex = mergedRuns.size() + 1;
+            std::string mergedRun = tempPath(tempDir, "chunk_run_p" + std::to_string(pass) + "_" +
+                                                          std::to_string(groupIndex) + ".tbl");
+            // Merged before the sort was interrupted: only its runs may be left to remove
+            if (checkpointedMerge(pass, groupIndex) != mergedRun) {
+                LineChecksum checksum = mergeRuns(group, sortColumns, mergedRun, false, phase);
+                checkpointMerge(pass, groupIndex, mergedRun, checksum, group);
+            }
+            for (const auto &run : group) {
+                std::remove(run.c_str());
+            }
+            mergedRuns.push_back(mergedRun);
+        }
+        runFiles = mergedRuns;
+        metricsCount("merge passes", 1);
+    }
+    mergeRuns(runFiles, sortColumns, outputFile, true, phase);
+    metricsCount("merge passes", 1);
+    for (const auto &run : runFiles) {
+        std::remove(run.c_str());
+    }
+}
 
-// Main Function
-int main() {
-    int B_MB, M_GB, column;
-    std::cout << "Enter the size of the buffer [MB] (MAXIMUM 200): ";
-    std::cin >> B_MB;
-    std::cout << "Enter the size of the memory [MB]  (MAXIMUM 1024 (1GB)): ";
-    std::cin >> M_GB;
-    std::cout << "Enter the column to sort by (0 to 15): ";
-    std::cin >> column;
-
-    if (column < 0 || column >= 16) {
-        std::cerr << "Invalid column index!" << std::endl;
+int main(int argc, char *argv[]) {
+    SortOptions options;
+    options.outputFile = "lineitem_sorted_foi.tbl";
+    if (argc > 1 ? !parseSortOptions(argc, argv, options) : !readSortOptionsInteractively(options)) {
         return 1;
     }
-    if (M_GB > 1024 || M_GB < 0 || B_MB > 200 || B_MB < 0 || B_MB > M_GB) {
-        std::cerr << "Invalid buffer or memory size!" << std::endl;
-        return 1;
+    metricsInit();
+    openSortCheckpoint(options, "serial");
+
+    auto start = std::chrono::high_resolution_clock::now();
+    separateColumnsToChunksWithBuffer(options.inputFile, options.bufferSize, options.tempDir);
+
+    std::vector<std::string> columnFiles;
+    for (int i = 1; i <= 16; ++i) {
+        columnFiles.push_back(tempPath(options.tempDir, "chunk_col" + std::to_string(i) + ".tbl"));
     }
 
-    int B = B_MB * 1024 * 1024;
-    int M = M_GB * 1024 * 1024;
+    // Sort the rows by the selected column into runs
+    std::vector<std::string> runFiles = sortSelectedColumnChunkWithMemory(columnFiles, options.sortColumns,
+                                                                           options.memorySize, options.tempDir);
 
-    auto start = std::chrono::high_resolution_clock::now();
-    separateColumnsToChunksWithBuffer("TPC-H/dbgen/lineitem.tbl", B);
-
-    // Sort the selected column
-    std::string selectedColumnFile = "chunk_col" + std::to_string(column + 1) + ".tbl";
-    std::string sortedColumnFile = "chunk_col" + std::to_string(column + 1) + "_sorted.tbl";
-    sortSelectedColumnChunkWithMemory(selectedColumnFile, sortedColumnFile, M);
-
-    // Merge all columns based on the sorted column
-    std::vector<std::string> columnFiles = {
-        "chunk_col1.tbl", "chunk_col2.tbl", "chunk_col3.tbl", "chunk_col4.tbl",
-        "chunk_col5.tbl", "chunk_col6.tbl", "chunk_col7.tbl", "chunk_col8.tbl",
-        "chunk_col9.tbl", "chunk_col10.tbl", "chunk_col11.tbl", "chunk_col12.tbl",
-        "chunk_col13.tbl", "chunk_col14.tbl", "chunk_col15.tbl", "chunk_col16.tbl"
-    };
-    mergeColumnsWithSortedColumn(sortedColumnFile, columnFiles, column, "lineitem_sorted_foi.tbl");
+    // Merge the runs into the final sorted table and its sparse index
+    mergeChunksWithSortedColumn(runFiles, options.sortColumns, options.outputFile, options.mergeFanIn, options.tempDir);
+    closeSortCheckpoint();
 
     auto end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> elapsed = end - start;
 
-    std::cout << "Sorting by column " << column << " completed successfully.\n";
+    std::cout << "Sorting by column " << options.sortColumns[0] << " completed successfully.\n";
     std::cout << "Elapsed time: " << elapsed.count() << " seconds." << std::endl;
+    metricsReport();
 
     return 0;
 }
\ No newline at end of file
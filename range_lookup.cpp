@@ -0,0 +1,162 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include "zone_map.h"
+
+// Extra predicate on any column: min <= value <= max
+struct ColumnRange {
+    int column;
+    std::string min;
+    std::string max;
+};
+
+// Utility: Split a string by a delimiter
+std::vector<std::string> split(const std::string &str, char delimiter) {
+    std::vector<std::string> tokens;
+    size_t start = 0, end;
+    while ((end = str.find(delimiter, start)) != std::string::npos) {
+        tokens.push_back(str.substr(start, end - start));
+        start = end + 1;
+    }
+    tokens.push_back(str.substr(start));
+    return tokens;
+}
+
+// Check min <= value <= max for the given column
+bool inRange(int column, const std::string &value, const std::string &min, const std::string &max) {
+    return !columnValueLess(column, value, min) && !columnValueLess(column, max, value);
+}
+
+// Load the sparse index of a sorted table
+std::vector<ZoneMap> loadZoneMaps(const std::string &indexFile, int &sortedColumnIndex) {
+    std::ifstream file(indexFile);
+    if (!file.is_open()) {
+        std::cerr << "Error opening index file: " << indexFile << std::endl;
+        exit(1);
+    }
+
+    std::string line;
+    std::getline(file, line);
+    size_t columns = 0;
+    if (!parseZoneMapHeader(line, sortedColumnIndex, columns)) {
+        std::cerr << "Malformed index header: " << line << std::endl;
+        exit(1);
+    }
+
+    std::vector<ZoneMap> zones;
+    while (std::getline(file, line)) {
+        ZoneMap zone;
+        if (!parseZoneMap(line, columns, zone)) {
+            std::cerr << "Malformed index row: " << line << std::endl;
+            continue;
+        }
+        zones.push_back(zone);
+    }
+    file.close();
+    return zones;
+}
+
+// A block can be skipped when one of the predicates is outside its min/max
+bool zoneMayMatch(const ZoneMap &zone, const std::vector<ColumnRange> &predicates) {
+    for (const auto &predicate : predicates) {
+        if (columnValueLess(predicate.column, zone.maxValues[predicate.column], predicate.min) ||
+            columnValueLess(predicate.column, predicate.max, zone.minValues[predicate.column])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <sorted table> <low key> <high key> [column=min:max ...]" << std::endl;
+        std::cerr << "Example: " << argv[0] << " lineitem_sorted_OMP.tbl 1995-03-01 1995-03-31 4=10:20" << std::endl;
+        return 1;
+    }
+
+    std::string tableFile = argv[1];
+    int sortedColumnIndex;
+    std::vector<ZoneMap> zones = loadZoneMaps(tableFile + ".idx", sortedColumnIndex);
+
+    // The key range is just another predicate, on the sorted column
+    std::vector<ColumnRange> predicates = {{sortedColumnIndex, argv[2], argv[3]}};
+    for (int i = 4; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t equal = arg.find('='), colon = arg.find(':');
+        if (equal == std::string::npos || colon == std::string::npos || colon < equal) {
+            std::cerr << "Invalid predicate: " << arg << std::endl;
+            return 1;
+        }
+        int column = std::stoi(arg.substr(0, equal));
+        if (column < 0 || column >= 16) {
+            std::cerr << "Invalid column index!" << std::endl;
+            return 1;
+        }
+        predicates.push_back({column, arg.substr(equal + 1, colon - equal - 1), arg.substr(colon + 1)});
+    }
+
+    std::ifstream file(tableFile, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error opening table file: " << tableFile << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Binary search the first block that may contain the low key
+    auto first = std::partition_point(zones.begin(), zones.end(), [&](const ZoneMap &zone) {
+        return columnValueLess(sortedColumnIndex, zone.maxValues[sortedColumnIndex], predicates[0].min);
+    });
+
+    size_t blocksRead = 0, rowsFound = 0;
+    long long bytesRead = 0;
+    std::string block;
+
+    // Read blocks until their first key is past the high key
+    for (auto zone = first; zone != zones.end(); ++zone) {
+        if (columnValueLess(sortedColumnIndex, predicates[0].max, zone->firstKey)) {
+            break;
+        }
+        if (!zoneMayMatch(*zone, predicates)) {
+            continue;
+        }
+
+        block.resize(zone->length);
+        file.seekg(zone->offset);
+        file.read(&block[0], zone->length);
+        blocksRead++;
+        bytesRead += zone->length;
+
+        size_t lineStart = 0, lineEnd;
+        while ((lineEnd = block.find('\n', lineStart)) != std::string::npos) {
+            std::string line = block.substr(lineStart, lineEnd - lineStart);
+            lineStart = lineEnd + 1;
+
+            std::vector<std::string> values = split(line, '|');
+            bool match = true;
+            for (const auto &predicate : predicates) {
+                if (!inRange(predicate.column, values[predicate.column], predicate.min, predicate.max)) {
+                    match = false;
+                    break;
+                }
+            }
+            if (match) {
+                std::cout << line << "\n";
+                rowsFound++;
+            }
+        }
+    }
+    file.close();
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+
+    std::cerr << rowsFound << " rows found, " << blocksRead << " of " << zones.size()
+              << " blocks read (" << bytesRead << " bytes)." << std::endl;
+    std::cerr << "Elapsed time: " << elapsed.count() << " seconds." << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,254 @@
+#ifndef SORT_OPTIONS_H
+#define SORT_OPTIONS_H
+
+// Command line of the second part (external sort of lineitem).
+// Sizes are 64-bit and accept K, M, G or T suffixes (a bare number is in MB, as in the interactive prompts).
+// With --auto, the memory, buffer, merge fan-in and threads are sized from the machine:
+// cgroup memory and CPU limits, MemAvailable in /proc/meminfo, the number of CPUs and the open files limit.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include <thread>
+#include <sys/resource.h>
+
+struct SortOptions {
+    std::string inputFile = "TPC-H/dbgen/lineitem.tbl";
+    std::string outputFile;
+    std::string tempDir = ".";
+    std::vector<int> sortColumns;
+    long long bufferSize = 0;
+    long long memorySize = 0;
+    int threads = 0;
+    int mergeFanIn = 0;
+    bool autoSize = false;
+    bool resume = true;
+    // B, M and fan-in as given by the user (0 when sized automatically): they identify the sort when it resumes
+    long long givenBufferSize = 0;
+    long long givenMemorySize = 0;
+    int givenMergeFanIn = 0;
+};
+
+const long long MB = 1024LL * 1024;
+
+// Path of a temporary file (column chunks, runs) inside the temp directory
+inline std::string tempPath(const std::string &tempDir, const std::string &name) {
+    if (tempDir.empty() || tempDir == ".") return name;
+    return tempDir.back() == '/' ? tempDir + name : tempDir + "/" + name;
+}
+
+// Parse "512", "512M", "64K", "8G" or "1T" into bytes; -1 if invalid
+inline long long parseSize(const std::string &text) {
+    size_t digits = 0;
+    while (digits < text.size() && std::isdigit(static_cast<unsigned char>(text[digits]))) digits++;
+    if (digits == 0 || digits + 2 < text.size()) return -1;
+
+    long long value = std::stoll(text.substr(0, digits));
+    std::string unit = text.substr(digits);
+    if (!unit.empty() && (unit.back() == 'B' || unit.back() == 'b') && unit.size() > 1) unit.pop_back();
+    if (unit.empty() || unit == "M" || unit == "m") return value * MB;
+    if (unit == "K" || unit == "k") return value * 1024;
+    if (unit == "G" || unit == "g") return value * 1024 * MB;
+    if (unit == "T" || unit == "t") return value * 1024 * 1024 * MB;
+    if (unit == "B" || unit == "b") return value;
+    return -1;
+}
+
+// Parse "10" or "10,11" into column indexes
+inline bool parseColumns(const std::string &text, std::vector<int> &columns) {
+    columns.clear();
+    std::stringstream ss(text);
+    std::string value;
+    while (std::getline(ss, value, ',')) {
+        if (value.empty() || !std::all_of(value.begin(), value.end(), ::isdigit)) return false;
+        int column = std::stoi(value);
+        if (column < 0 || column >= 16) return false;
+        columns.push_back(column);
+    }
+    return !columns.empty();
+}
+
+// Parse a count given on the command line (threads, fan-in); -1 if it is not a plain number
+inline int parseCount(const std::string &text) {
+    if (text.empty() || text.size() > 9 || !std::all_of(text.begin(), text.end(), ::isdigit)) return -1;
+    return std::stoi(text);
+}
+
+// First number found in a file (cgroup limits, "max" meaning no limit); -1 if none
+inline long long readLimit(const std::string &file) {
+    std::ifstream in(file);
+    std::string value;
+    if (!(in >> value) || value == "max" || !std::isdigit(static_cast<unsigned char>(value[0]))) return -1;
+    return std::stoll(value);
+}
+
+// Memory the process may use: the smaller of the cgroup limit and MemAvailable
+inline long long availableMemory() {
+    long long limit = -1;
+    for (const char *file : {"/sys/fs/cgroup/memory.max", "/sys/fs/cgroup/memory/memory.limit_in_bytes"}) {
+        long long value = readLimit(file);
+        // cgroup v1 reports a huge number when there is no limit
+        if (value > 0 && value < (1LL << 60)) {
+            limit = value;
+            break;
+        }
+    }
+
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    long long valueKB;
+    std::string unit;
+    while (meminfo >> key >> valueKB >> unit) {
+        if (key == "MemAvailable:") {
+            long long available = valueKB * 1024;
+            limit = limit < 0 ? available : std::min(limit, available);
+            break;
+        }
+    }
+    return limit > 0 ? limit : 1024 * MB;
+}
+
+// CPUs the process may use: the cgroup CPU quota if any, otherwise the number of CPUs
+inline int availableCpus() {
+    int cpus = std::max(1u, std::thread::hardware_concurrency());
+    std::ifstream cpuMax("/sys/fs/cgroup/cpu.max");
+    std::string quota, period;
+    if (cpuMax >> quota >> period && quota != "max") {
+        cpus = std::min(cpus, static_cast<int>(std::max(1LL, std::stoll(quota) / std::stoll(period))));
+    }
+    return cpus;
+}
+
+// Runs merged at once: each run gets at least 4 MB of the memory, within the open files limit
+inline int autoMergeFanIn(long long memorySize) {
+    struct rlimit files;
+    long long maxFiles = getrlimit(RLIMIT_NOFILE, &files) == 0 ? static_cast<long long>(files.rlim_cur) : 1024;
+    long long fanIn = std::min(memorySize / (4 * MB), maxFiles - 64);
+    return static_cast<int>(std::max(2LL, std::min(fanIn, 4096LL)));
+}
+
+// Fill what was not given on the command line from the resources of the machine
+inline void autoSizeOptions(SortOptions &options) {
+    if (options.memorySize == 0) {
+        // Half of the available memory: the in-memory rows cost more than their size in the file
+        options.memorySize = std::max(16 * MB, availableMemory() / 2);
+    }
+    if (options.bufferSize == 0) {
+        options.bufferSize = std::max(MB, std::min(options.memorySize / 16, 1024 * MB));
+    }
+    if (options.threads == 0) {
+        options.threads = availableCpus();
+    }
+    if (options.mergeFanIn == 0) {
+        options.mergeFanIn = autoMergeFanIn(options.memorySize);
+    }
+}
+
+inline void printSortUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --input <file>       lineitem table (default TPC-H/dbgen/lineitem.tbl)\n"
+              << "  --output <file>      sorted table\n"
+              << "  --temp-dir <dir>     folder of the column chunks and runs (default .)\n"
+              << "  --key <c1[,c2...]>   columns to sort by, from 0 to 15\n"
+              << "  --buffer <size>      buffer size B, e.g. 64M\n"
+              << "  --memory <size>      memory size M, e.g. 8G\n"
+              << "  --threads <n>        OpenMP threads (OMP version only; the serial version ignores it)\n"
+              << "  --fan-in <n>         runs merged at once\n"
+              << "  --auto               size B, M, threads and fan-in from the machine\n"
+              << "  --no-resume          start over instead of resuming an interrupted sort\n"
+              << "Without options, B, M and the column are asked interactively." << std::endl;
+}
+
+// Parse the command line; false (after printing why) if it is invalid
+inline bool parseSortOptions(int argc, char *argv[], SortOptions &options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--auto") {
+            options.autoSize = true;
+            continue;
+        }
+        if (option == "--no-resume") {
+            options.resume = false;
+            continue;
+        }
+        if (option == "--help" || i + 1 >= argc) {
+            printSortUsage(argv[0]);
+            return false;
+        }
+        std::string value = argv[++i];
+        if (option == "--input") options.inputFile = value;
+        else if (option == "--output") options.outputFile = value;
+        else if (option == "--temp-dir") options.tempDir = value;
+        else if (option == "--key") {
+            if (!parseColumns(value, options.sortColumns)) {
+                std::cerr << "Invalid column index!" << std::endl;
+                return false;
+            }
+        } else if (option == "--buffer") options.bufferSize = parseSize(value);
+        else if (option == "--memory") options.memorySize = parseSize(value);
+        else if (option == "--threads") options.threads = parseCount(value);
+        else if (option == "--fan-in") options.mergeFanIn = parseCount(value);
+        else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            printSortUsage(argv[0]);
+            return false;
+        }
+    }
+
+    options.givenBufferSize = options.bufferSize;
+    options.givenMemorySize = options.memorySize;
+    options.givenMergeFanIn = options.mergeFanIn;
+    if (options.autoSize) {
+        autoSizeOptions(options);
+        std::cout << "Auto: memory " << options.memorySize / MB << " MB, buffer " << options.bufferSize / MB
+                  << " MB, " << options.threads << " threads, fan-in " << options.mergeFanIn << "." << std::endl;
+    }
+    if (options.sortColumns.empty()) {
+        std::cerr << "Missing --key (column to sort by, from 0 to 15)." << std::endl;
+        return false;
+    }
+    if (options.bufferSize <= 0 || options.memorySize <= 0 || options.bufferSize > options.memorySize) {
+        std::cerr << "Invalid buffer or memory size!" << std::endl;
+        return false;
+    }
+    if (options.threads < 0 || (options.mergeFanIn != 0 && options.mergeFanIn < 2)) {
+        std::cerr << "Invalid number of threads or fan-in!" << std::endl;
+        return false;
+    }
+    if (options.mergeFanIn == 0) {
+        options.mergeFanIn = autoMergeFanIn(options.memorySize);
+    }
+    return true;
+}
+
+// The original interactive prompts, used when the program is run without options
+inline bool readSortOptionsInteractively(SortOptions &options) {
+    long long B_MB, M_MB;
+    int column;
+    std::cout << "Enter the size of the buffer [MB]: ";
+    std::cin >> B_MB;
+    std::cout << "Enter the size of the memory [MB]: ";
+    std::cin >> M_MB;
+    std::cout << "Enter the column to sort by (0 to 15): ";
+    std::cin >> column;
+
+    if (!std::cin || column < 0 || column >= 16) {
+        std::cerr << "Invalid column index!" << std::endl;
+        return false;
+    }
+    if (M_MB <= 0 || B_MB <= 0 || B_MB > M_MB) {
+        std::cerr << "Invalid buffer or memory size!" << std::endl;
+        return false;
+    }
+    options.sortColumns = {column};
+    options.bufferSize = options.givenBufferSize = B_MB * MB;
+    options.memorySize = options.givenMemorySize = M_MB * MB;
+    options.mergeFanIn = autoMergeFanIn(options.memorySize);
+    return true;
+}
+
+#endif
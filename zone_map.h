@@ -0,0 +1,126 @@
+#ifndef ZONE_MAP_H
+#define ZONE_MAP_H
+
+// Sparse index of a sorted lineitem table (<table>.idx), written by the second part and by incremental_merge,
+// and read by range_lookup and incremental_merge:
+//   #zonemap|<sorted column>|<rows per block>|<columns>
+//   <first key>|<offset>|<length>|<rows>|<min of column 0>|<max of column 0>|...|<min of column 15>|<max of column 15>
+// One line per block of ZONE_MAP_BLOCK_ROWS rows: the first key of the block, its byte offset and length in the
+// sorted file, its number of rows, and the min/max of every column (zone maps).
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Number of rows summarized by each entry of the sparse index
+const size_t ZONE_MAP_BLOCK_ROWS = 1024;
+
+// Columns of lineitem, each with its min/max in every entry
+const size_t ZONE_MAP_COLUMNS = 16;
+
+// Sparse index entry: first key, position of the block in the sorted file and min/max of every column
+struct ZoneMap {
+    std::string firstKey;
+    long long offset = 0;
+    long long length = 0;
+    size_t rows = 0;
+    std::vector<std::string> minValues;
+    std::vector<std::string> maxValues;
+};
+
+// Columns 0 to 7 are numeric, the others are compared as text (dates are YYYY-MM-DD)
+inline bool isNumericColumn(int column) {
+    return column >= 0 && column < 8;
+}
+
+// Compare two values of the same column
+inline bool columnValueLess(int column, const std::string &a, const std::string &b) {
+    if (isNumericColumn(column)) {
+        return std::stod(a) < std::stod(b);
+    }
+    return a < b;
+}
+
+inline std::vector<std::string> splitIndexLine(const std::string &line) {
+    std::vector<std::string> fields;
+    size_t start = 0, end;
+    while ((end = line.find('|', start)) != std::string::npos) {
+        fields.push_back(line.substr(start, end - start));
+        start = end + 1;
+    }
+    fields.push_back(line.substr(start));
+    return fields;
+}
+
+inline void writeZoneMapHeader(std::ostream &indexFile, int sortedColumnIndex) {
+    indexFile << "#zonemap|" << sortedColumnIndex << "|" << ZONE_MAP_BLOCK_ROWS << "|" << ZONE_MAP_COLUMNS << "\n";
+}
+
+// Parse the header line of an index; false if it is not one
+inline bool parseZoneMapHeader(const std::string &line, int &sortedColumnIndex, size_t &columns) {
+    std::vector<std::string> fields = splitIndexLine(line);
+    if (fields.size() != 4 || fields[0] != "#zonemap") {
+        return false;
+    }
+    try {
+        sortedColumnIndex = std::stoi(fields[1]);
+        columns = std::stoul(fields[3]);
+    } catch (const std::exception &) {
+        return false;
+    }
+    return true;
+}
+
+// Add a row to the current block, updating the min/max of each column
+inline void updateZoneMap(ZoneMap &zone, const std::string &line, int sortedColumnIndex, long long offset) {
+    std::vector<std::string> values = splitIndexLine(line);
+    if (zone.rows == 0) {
+        zone.firstKey = values[sortedColumnIndex];
+        zone.offset = offset;
+        zone.length = 0;
+        zone.minValues = values;
+        zone.maxValues = values;
+    } else {
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (columnValueLess(i, values[i], zone.minValues[i])) zone.minValues[i] = values[i];
+            if (columnValueLess(i, zone.maxValues[i], values[i])) zone.maxValues[i] = values[i];
+        }
+    }
+    zone.length += line.size() + 1;
+    zone.rows++;
+}
+
+// Write one block of the sparse index and start the next one
+inline void writeZoneMap(std::ostream &indexFile, ZoneMap &zone) {
+    indexFile << zone.firstKey << "|" << zone.offset << "|" << zone.length << "|" << zone.rows;
+    for (size_t i = 0; i < zone.minValues.size(); ++i) {
+        indexFile << "|" << zone.minValues[i] << "|" << zone.maxValues[i];
+    }
+    indexFile << "\n";
+    zone.rows = 0;
+}
+
+// Parse one entry of an index with `columns` columns; false if it is malformed
+inline bool parseZoneMap(const std::string &line, size_t columns, ZoneMap &zone) {
+    std::vector<std::string> fields = splitIndexLine(line);
+    if (fields.size() != 4 + 2 * columns) {
+        return false;
+    }
+    try {
+        zone.firstKey = fields[0];
+        zone.offset = std::stoll(fields[1]);
+        zone.length = std::stoll(fields[2]);
+        zone.rows = std::stoul(fields[3]);
+    } catch (const std::exception &) {
+        return false;
+    }
+    zone.minValues.clear();
+    zone.maxValues.clear();
+    for (size_t i = 0; i < columns; ++i) {
+        zone.minValues.push_back(fields[4 + 2 * i]);
+        zone.maxValues.push_back(fields[5 + 2 * i]);
+    }
+    return true;
+}
+
+#endif